@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE  // Enable usleep and other POSIX features
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "structures.h"
+
+// Microbenchmarks of the primitives of structures.c: every benchmark runs once as warmup, then `repetitions` times,
+// and reports the median ns/op (min and max show how stable it was). Build with: make bench
+
+int repetitions = 7;
+long ops = 200000;     // operations per repetition
+int max_producers = 8;
+
+typedef double (*BenchFunction)(void *arg); // runs the operations once, returns the ns per operation
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(char *name, BenchFunction bench, void *arg) {
+    double *ns_op = malloc(sizeof(double) * repetitions);
+    bench(arg); // warmup: page faults, caches, branch predictors
+    for (int r = 0; r < repetitions; r++) {
+        ns_op[r] = bench(arg);
+    }
+    qsort(ns_op, repetitions, sizeof(double), compare_double);
+    printf("[BENCH] %-46s %10.1f ns/op   (min %.1f, max %.1f, %d reps)\n",
+           name, ns_op[repetitions / 2], ns_op[0], ns_op[repetitions - 1], repetitions);
+    free(ns_op);
+}
+
+// enqueue_request / dequeue_request: `producers` threads enqueue, the CCM role dequeues everything
+// the lanes hold QUEUE_BENCH_LANE requests (the simulation has that many aeronaves): the producers keep at most
+// QUEUE_BENCH_IN_FLIGHT requests queued, so a lane is never full whatever the number of operations
+#define QUEUE_BENCH_LANE 4096
+#define QUEUE_BENCH_IN_FLIGHT (QUEUE_BENCH_LANE - 64) // each producer can pass the check at the same time: 64 more at most
+
+typedef struct{
+    Simulation *sim;
+    int producers;
+    long per_producer;
+    long in_flight; // enqueued and not dequeued yet
+}QueueBench;
+
+typedef struct{
+    QueueBench *qb;
+    int id;
+}Producer;
+
+static void* producer_thread(void *arg) {
+    Producer *p = (Producer *)arg;
+    RequestSector req = {0};
+    req.id_aeronave = p->id;
+    req.id_sector_from = -1;
+    for (long i = 0; i < p->qb->per_producer; i++) {
+        req.id_sector = (int)(i % p->qb->sim->number_sectors);
+        req.tier = (int)(i % NUM_SERVICE_TIERS);
+        while (__atomic_load_n(&p->qb->in_flight, __ATOMIC_RELAXED) >= QUEUE_BENCH_IN_FLIGHT) sched_yield();
+        __atomic_add_fetch(&p->qb->in_flight, 1, __ATOMIC_RELAXED);
+        enqueue_request(p->qb->sim->ccm, &req);
+    }
+    return NULL;
+}
+
+static double bench_queue(void *arg) {
+    QueueBench *qb = (QueueBench *)arg;
+    pthread_t threads[64];
+    Producer producers[64];
+    long total = qb->per_producer * qb->producers;
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < qb->producers; i++) {
+        producers[i].qb = qb;
+        producers[i].id = i;
+        pthread_create(&threads[i], NULL, producer_thread, &producers[i]);
+    }
+    for (long done = 0; done < total; ) {
+        if (dequeue_request(qb->sim->ccm) != NULL) {
+            __atomic_sub_fetch(&qb->in_flight, 1, __ATOMIC_RELAXED);
+            done++;
+        }
+        else sched_yield();
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    for (int i = 0; i < qb->producers; i++) pthread_join(threads[i], NULL);
+    return (double)elapsed / total;
+}
+
+// insert_aeronave_mutex_priority / remove_aeronave_mutex_priority on a list kept at `size` aeronaves
+typedef struct{
+    MutexPriority *mp;
+    Aeronave *aeronaves;
+    int size;
+}ListBench;
+
+static double bench_waiting_list(void *arg) {
+    ListBench *lb = (ListBench *)arg;
+    for (int i = 0; i < lb->size - 1; i++) insert_aeronave_mutex_priority(lb->mp, &lb->aeronaves[i]);
+    int next = lb->size - 1;
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < ops; i++) { // one insert + one remove per op, the list size doesn't change
+        insert_aeronave_mutex_priority(lb->mp, &lb->aeronaves[next]);
+        Aeronave *out = remove_aeronave_mutex_priority(lb->mp);
+        next = out - lb->aeronaves;
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    while (remove_aeronave_mutex_priority(lb->mp) != NULL) {}
+    return (double)elapsed / ops;
+}
+
+// control_priority: each op is one request processed by the CCM
+typedef struct{
+    Simulation *sim;
+    int contenders; // aeronaves asking for the same sector (1: the sector is always free)
+}ControlBench;
+
+static double bench_control_priority(void *arg) {
+    ControlBench *cb = (ControlBench *)arg;
+    Simulation *sim = cb->sim;
+    RequestSector enter = {0}, release = {0};
+    enter.request_type = 0;
+    enter.id_sector_from = -1;
+    release.request_type = 1;
+    release.id_sector_from = -1;
+    long rounds = ops / (2 * cb->contenders);
+    uint64_t start = monotonic_ns();
+    for (long r = 0; r < rounds; r++) {
+        int sector = (int)(r % sim->number_sectors);
+        enter.id_sector = sector;
+        release.id_sector = sector;
+        for (int a = 0; a < cb->contenders; a++) { // the first one gets the sector, the others wait for it
+            enter.id_aeronave = a;
+            control_priority(sim, &enter);
+        }
+        for (int a = 0; a < cb->contenders; a++) { // each release hands the sector to the next one
+            release.id_aeronave = a;
+            control_priority(sim, &release);
+        }
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    for (int a = 0; a < cb->contenders; a++) { // the grants posted the semaphores, nobody waited for them
+        while (sem_trywait(&sim->ccm->semaphores_aeronaves[a]) == 0) {}
+    }
+    return (double)elapsed / (rounds * 2 * cb->contenders);
+}
+
+// semaphore wake path: the CCM role posts the aeronave, which returns from wait_sector() and posts back
+typedef struct{
+    Simulation *sim;
+    sem_t back;
+    long rounds;
+}WakeBench;
+
+static void* woken_aeronave(void *arg) {
+    WakeBench *wb = (WakeBench *)arg;
+    for (long i = 0; i < wb->rounds; i++) {
+        wait_sector(wb->sim, wb->sim->aeronaves[0]);
+        sem_post(&wb->back);
+    }
+    return NULL;
+}
+
+static double bench_wake(void *arg) {
+    WakeBench *wb = (WakeBench *)arg;
+    pthread_t thread;
+    pthread_create(&thread, NULL, woken_aeronave, wb);
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < wb->rounds; i++) {
+        sem_post(&wb->sim->ccm->semaphores_aeronaves[0]);
+        sem_wait(&wb->back);
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    pthread_join(thread, NULL);
+    return (double)elapsed / (2 * wb->rounds); // two wakes per round
+}
+
+// snapshot_airspace without a CCM writing at the same time (with a loaded simulation: trabalho_final -M monitors)
+typedef struct{
+    Simulation *sim;
+    AirspaceSnapshot *snapshot;
+}SnapshotBench;
+
+static double bench_snapshot(void *arg) {
+    SnapshotBench *sb = (SnapshotBench *)arg;
+    long rounds = ops / sb->sim->number_sectors + 1;
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < rounds; i++) snapshot_airspace(sb->sim, sb->snapshot);
+    return (double)(monotonic_ns() - start) / rounds;
+}
+
+static void* standby_function(void *arg) {
+    run_standby_ccm((Simulation *)arg);
+    return NULL;
+}
+
+static Simulation* bench_simulation(int number_sectors, int number_aeronaves) {
+    Simulation *sim = create_simulation(number_sectors, number_aeronaves, 1);
+    sim->ccm->verbose = 0;
+    sim->procedural_routes = 1; // the routes aren't used
+    for (int i = 0; i < number_aeronaves; i++) {
+        sim->aeronaves[i] = create_aeronave(sim, i, rand() % 1000, 1);
+    }
+    return sim;
+}
+
+static void usage(char *name) {
+    printf("Usage : %s [-r repetitions] [-n ops_per_repetition] [-p max_producers]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:p:")) != -1) {
+        switch (opt) {
+            case 'r': repetitions = atoi(optarg); break;
+            case 'n': ops = atol(optarg); break;
+            case 'p': max_producers = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (repetitions < 1 || ops < 1 || max_producers < 1 || max_producers > 64) {
+        usage(argv[0]);
+        return 1;
+    }
+    srand(1);
+    char name[64];
+
+    // the lanes are sized by the number of aeronaves (which aren't needed), one sector keeps the waiting lists small
+    Simulation *sim = create_simulation(1, QUEUE_BENCH_LANE, 1);
+    sim->ccm->verbose = 0;
+    for (int p = 1; p <= max_producers; p *= 2) {
+        QueueBench qb = {sim, p, ops / p, 0};
+        snprintf(name, sizeof(name), "enqueue+dequeue, %d producer(s)", p);
+        run_bench(name, bench_queue, &qb);
+    }
+    destroy_simulation(sim);
+
+    int sizes[] = {1, 16, 256, 4096};
+    for (int s = 0; s < 4; s++) {
+        ListBench lb;
+        lb.size = sizes[s];
+        lb.mp = create_mutex_priority(sizes[s], 0);
+        lb.aeronaves = calloc(sizes[s], sizeof(Aeronave));
+        for (int i = 0; i < sizes[s]; i++) {
+            lb.aeronaves[i].id = i;
+            lb.aeronaves[i].priority = rand() % 1000;
+        }
+        snprintf(name, sizeof(name), "waiting list insert+remove, %d aeronaves", sizes[s]);
+        run_bench(name, bench_waiting_list, &lb);
+        destroy_mutex_priority(lb.mp);
+        free(lb.aeronaves);
+    }
+
+    int contenders[] = {1, 4, 32};
+    sim = bench_simulation(64, 32);
+    for (int c = 0; c < 3; c++) {
+        ControlBench cb = {sim, contenders[c]};
+        snprintf(name, sizeof(name), "control_priority, %d aeronave(s) per sector", contenders[c]);
+        run_bench(name, bench_control_priority, &cb);
+    }
+    destroy_simulation(sim);
+
+    // same requests with a hot standby applying the replication log (it never takes over: no heartbeat is sent)
+    sim = bench_simulation(64, 32);
+    create_replication(sim, 1000);
+    pthread_t standby_thread;
+    pthread_create(&standby_thread, NULL, standby_function, sim);
+    for (int c = 0; c < 3; c++) {
+        ControlBench cb = {sim, contenders[c]};
+        snprintf(name, sizeof(name), "control_priority + standby, %d per sector", contenders[c]);
+        run_bench(name, bench_control_priority, &cb);
+    }
+    sim->stop = 1;
+    pthread_join(standby_thread, NULL);
+    destroy_simulation(sim);
+
+    int snapshot_sizes[] = {16, 1024};
+    for (int k = 0; k < 2; k++) {
+        sim = bench_simulation(snapshot_sizes[k], 1);
+        SnapshotBench sb = {sim, create_airspace_snapshot(sim)};
+        snprintf(name, sizeof(name), "snapshot_airspace, %d sectors", snapshot_sizes[k]);
+        run_bench(name, bench_snapshot, &sb);
+        destroy_airspace_snapshot(sb.snapshot);
+        destroy_simulation(sim);
+    }
+
+    sim = bench_simulation(1, 1);
+    for (int w = WAIT_BLOCK; w <= WAIT_BUSY_POLL; w++) {
+        if (w != WAIT_BLOCK && sysconf(_SC_NPROCESSORS_ONLN) < 2) { // the spinning aeronave would hold the only core
+            printf("[BENCH] wake (%s) skipped: needs 2 cores\n", wait_strategy_name(w));
+            continue;
+        }
+        WakeBench wb;
+        wb.sim = sim;
+        wb.rounds = ops / 20 > 0 ? ops / 20 : 1; // a wake costs a lot more than the other operations
+        sem_init(&wb.back, 0, 0);
+        sim->ccm->wait_strategy = (WaitStrategy)w;
+        snprintf(name, sizeof(name), "sem_post -> wait_sector() wake (%s)", wait_strategy_name(w));
+        run_bench(name, bench_wake, &wb);
+        sem_destroy(&wb.back);
+    }
+    destroy_simulation(sim);
+    return 0;
+}
@@ -3,129 +3,413 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <math.h>     // log, for the poisson arrivals
+#include <time.h>
+#include <sys/resource.h> // getrusage, cpu time of the run
 #include "structures.h"
 
 // global variables
-Sector ** sectors;
-Aeronave ** aeronaves;
-CentralizedControlMechanism * centralized_control_mechanism;
-int *thread_returns;
-int n_threads;
-
-int check_end_aeronaves(void){
-    for (int i = 0; i < n_threads; i++) {
-        if(!thread_returns[i]){ // if even single thread is still executing, return 0
-            return 0;
-        }
-    }
-    return 1;
-}
+Simulation * simulation;
+
+// open-system arrival mode: aeronaves keep arriving during duration_s and finished ones are reused
+int open_mode = 0;
+double arrival_rate = 0;        // aeronaves per second
+int fixed_arrivals = 0;         // 1: one arrival every 1/arrival_rate seconds, 0: poisson process
+double duration_s = 10;
+double warmup_s = 2;
+int max_tam_rota;
+uint64_t start_ns, warmup_end_ns, end_ns;
+uint64_t *inject_ns;            // time each slot's current aeronave was injected (start of the run in closed mode)
+int *free_slots;                // stack of the ids of the aeronaves that are not flying
+int num_free_slots;
+pthread_mutex_t slots_mutex = PTHREAD_MUTEX_INITIALIZER;
+LatencyHistogram flight_latency; // flights that ended after the warmup (every flight in closed mode), protected by slots_mutex
+long arrivals = 0, dropped_arrivals = 0, completed_in_window = 0;
+double mean_wait_us = 0;        // time the aeronaves spent in wait_sector(), per wait
+double cpu_s = 0;               // user + system cpu time of the whole run
+uint64_t timeouts = 0;          // requests that reached their deadline
+
+// monitors: threads reading snapshots of the airspace during the whole run, to measure the read throughput
+typedef struct{
+    pthread_t thread;
+    long snapshots;
+    long retries;
+    long inconsistent;          // snapshots where a sector has a waiting list but is free (can't happen in a consistent view)
+    uint64_t ns;                // time spent in snapshot_airspace()
+}Monitor;
+int num_monitors = 0;
+Monitor *monitors;
+volatile int monitors_stop = 0;
 
 void* thread_aeronave_function(void *arg) {
     Aeronave *a = (Aeronave *)arg;                    // use the real pointer instead of copying
-    init_aeronave(a);                                 // run loop inside the real aeronave
-    thread_returns[a->id] = 1; // tell everyone it has ended
+    init_aeronave(simulation, a);                     // run loop inside the real aeronave
+    uint64_t now = monotonic_ns();
+    pthread_mutex_lock(&slots_mutex);
+    if (now >= warmup_end_ns && now <= end_ns) {
+        latency_histogram_record(&flight_latency, now - inject_ns[a->id]);
+        completed_in_window++;
+    }
+    if (open_mode) free_slots[num_free_slots++] = a->id; // id, semaphore and rota can be used by the next arrival
+    pthread_mutex_unlock(&slots_mutex);
     pthread_exit(NULL);
 }
 
-void* thread_centralized_control_mechanism(void *arg) {
-    (void)arg;
-    printf("\033[32m[CCM_THREAD] Centralized Control Mechanism thread started\033[0m\n");
-    
-    // Main loop: continuously process requests from the queue
-    while (1) {
-        // Dequeue a request from the front of the queue (FIFO)
-        RequestSector * current_request = dequeue_request(centralized_control_mechanism);
-        
-        // Check if there is a valid request
-        if (current_request != NULL) {
-            printf("\033[32m[CCM_THREAD] Processing request: Aircraft %d for Sector %d\033[0m\n", 
-                   current_request->id_aeronave,
-                   current_request->id_sector);
-            
-            // Call control_priority to attempt to acquire the sector
-            // The call remains the same, the change was inside control_priority()
-            /* Sector * result = */control_priority(current_request, 
-                                              centralized_control_mechanism->mutex_sections,
-                                              &centralized_control_mechanism->mutex_request);
-            
-            // if (result != NULL) {
-            //     if(current_request->request_type == 0){
-            //         //printf("[CCM_THREAD] Request processed successfully. Sector %d assigned.\n", result->id);
-            //     }
-            //     else{
-            //         //printf("[CCM_THREAD] Request processed successfully. Sector %d free.\n", result->id);
-            //     }
-            // } else {
-            //     //printf("[CCM_THREAD] Sector busy. Aircraft will wait.\n");
-            // }
-        } 
-        else{
-            usleep(100);
+void* thread_monitor_function(void *arg) {
+    Monitor *m = (Monitor *)arg;
+    AirspaceSnapshot *snapshot = create_airspace_snapshot(simulation);
+    uint64_t last_version = 0;
+    while (!monitors_stop) {
+        uint64_t before = monotonic_ns();
+        m->retries += snapshot_airspace(simulation, snapshot);
+        m->ns += monotonic_ns() - before;
+        m->snapshots++;
+        int bad = snapshot->version < last_version;
+        for (int i = 0; i < snapshot->number_sectors; i++) {
+            if (snapshot->sectors[i].waiting > 0 && !snapshot->sectors[i].busy) bad = 1;
         }
-        if(check_end_aeronaves()){ // ends only if all other threads have too
-            pthread_exit(NULL);
+        m->inconsistent += bad;
+        last_version = snapshot->version;
+    }
+    destroy_airspace_snapshot(snapshot);
+    return NULL;
+}
+
+// seconds until the next arrival
+static double next_interarrival(void) {
+    if (fixed_arrivals) return 1.0 / arrival_rate;
+    double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0); // in ]0, 1[
+    return -log(u) / arrival_rate;
+}
+
+// injects aeronaves in the free slots until duration_s is over
+void* thread_injector_function(void *arg) {
+    pthread_t *aeronaves_threads = (pthread_t *)arg;
+    int *started = calloc(simulation->number_aeronaves, sizeof(int)); // 1 if the slot has a thread that must be joined before reuse
+    uint64_t next_ns = start_ns;
+
+    while (1) {
+        next_ns += (uint64_t)(next_interarrival() * 1e9);
+        if (next_ns >= end_ns) break;
+        uint64_t now = monotonic_ns();
+        if (next_ns > now) usleep((next_ns - now) / 1000);
+
+        arrivals++;
+        pthread_mutex_lock(&slots_mutex);
+        int slot = num_free_slots > 0 ? free_slots[--num_free_slots] : -1;
+        pthread_mutex_unlock(&slots_mutex);
+        if (slot < 0) { // every aeronave is flying, the arrival is lost
+            dropped_arrivals++;
+            continue;
         }
+        if (started[slot]) pthread_join(aeronaves_threads[slot], NULL);
+        Aeronave *a = simulation->aeronaves[slot];
+        reset_aeronave(simulation, a, rand() % 1000, rand() % max_tam_rota + 1);
+        inject_ns[slot] = monotonic_ns();
+        started[slot] = 1;
+        pthread_create(&aeronaves_threads[slot], NULL, thread_aeronave_function, (void *)a);
+    }
+
+    // wait for the aeronaves still flying
+    for (int i = 0; i < simulation->number_aeronaves; i++) {
+        if (started[i]) pthread_join(aeronaves_threads[i], NULL);
     }
-    
-    printf("\033[32m[CCM_THREAD] Centralized Control Mechanism thread finished\033[0m\n");
+    free(started);
+    pthread_exit(NULL);
+}
+
+void* thread_standby_function(void *arg) {
+    (void)arg;
+    run_standby_ccm(simulation); // applies the replication log, runs the CCM loop after a failover
+    return NULL;
+}
+
+void* thread_centralized_control_mechanism(void *arg) {
+    (void)arg;
+    run_centralized_control(simulation); // ends when simulation->stop is set, after every aeronave has finished
     pthread_exit(NULL);
     return NULL;
 }
 
 
+static void usage(char *name) {
+    printf("Usage : %s [-q] [-s seed] [-d max_dwell_ms] [-W block|spin|poll] [-T timeout_ms [-R]] [-o results.csv] [-r arrivals_per_second [-t duration_s] [-w warmup_s] [-f]] [-P] [-F routes.txt] [-M monitors] [-H heartbeat_timeout_ms [-K n]] [-X trace.csv] <number_sectors> <number_aeronaves>\n", name);
+    printf("  -q  quiet: only the results are printed\n");
+    printf("  -s  seed of rand() (default: current time)\n");
+    printf("  -d  each aeronave stays between 1 and max_dwell_ms ms in a sector (default 5)\n");
+    printf("  -W  how the aeronaves wait for the CCM: block in sem_wait (default), spin then block, or busy poll\n");
+    printf("  -T  an aeronave stops waiting for a sector after timeout_ms, waits a random time and asks again\n");
+    printf("  -R  after a timeout the aeronave changes the next sector of its route instead of asking again\n");
+    printf("  -o  appends the results as a csv row to the file (the header is written if the file is empty)\n");
+    printf("  -r  open-system mode: aeronaves arrive during the run (poisson process) instead of all starting together,\n");
+    printf("      <number_aeronaves> is then the maximum number of aeronaves flying at the same time\n");
+    printf("  -t  duration of the open-system run in seconds (default 10)\n");
+    printf("  -w  warmup in seconds, ignored by the throughput and latency report (default 2)\n");
+    printf("  -f  fixed interval between arrivals instead of a poisson process\n");
+    printf("  -P  procedural routes: each route is a seed and a length, the next sector is generated when it's needed\n");
+    printf("  -H  hot standby CCM: replicates the state of the CCM and takes over after heartbeat_timeout_ms without heartbeat\n");
+    printf("  -K  fault injection: the CCM dies after n requests (needs -H)\n");
+    printf("  -X  writes the tracepoints of the run to the file (csv, read by trace_report; needs make TRACE=1)\n");
+    printf("  -M  monitor threads reading snapshots of the sectors during the run (read throughput benchmark)\n");
+    printf("  -F  routes file, one route per line (sector ids): line i is the route of aeronave i (closed mode only)\n");
+}
+
+// one csv row per run, so sweep can aggregate many runs in a single file
+static void write_results_csv(char *path, int number_sectors, int number_aeronaves, unsigned int seed,
+                              double window_s, double throughput) {
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        printf("[RESULTS] Error: can't open %s\n", path);
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "mode,sectors,aeronaves,max_dwell_ms,wait_strategy,arrival_rate,seed,window_s,arrivals,dropped,flights,"
+                   "throughput_per_s,latency_mean_ms,latency_p50_ms,latency_p99_ms,latency_max_ms,wait_mean_us,cpu_s,timeouts,"
+                   "grant_p99_tier0_us,grant_p99_tier1_us,grant_p99_tier2_us\n");
+    }
+    fprintf(f, "%s,%d,%d,%d,%s,%.3f,%u,%.3f,%ld,%ld,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu,%.3f,%.3f,%.3f\n",
+            open_mode ? (fixed_arrivals ? "fixed" : "poisson") : "closed",
+            number_sectors, number_aeronaves, simulation->ccm->max_dwell_ms,
+            wait_strategy_name(simulation->ccm->wait_strategy), arrival_rate, seed,
+            window_s, arrivals, dropped_arrivals, completed_in_window, throughput,
+            latency_histogram_mean(&flight_latency) / 1e6,
+            latency_histogram_percentile(&flight_latency, 50) / 1e6,
+            latency_histogram_percentile(&flight_latency, 99) / 1e6,
+            flight_latency.max_ns / 1e6, mean_wait_us, cpu_s, (unsigned long long)timeouts,
+            latency_histogram_percentile(&simulation->ccm->grant_latency[0], 99) / 1e3,
+            latency_histogram_percentile(&simulation->ccm->grant_latency[1], 99) / 1e3,
+            latency_histogram_percentile(&simulation->ccm->grant_latency[2], 99) / 1e3);
+    fclose(f);
+}
+
 int main(int argc, char *argv[]) {
+    unsigned int seed = (unsigned int)time(NULL);
+    int verbose = 1;
+    int max_dwell_ms = 5;
+    int wait_strategy = WAIT_BLOCK;
+    int request_timeout_ms = 0;
+    int reroute_on_timeout = 0;
+    char *results_path = NULL;
+    char *routes_path = NULL;
+    int procedural_routes = 0;
+    int heartbeat_timeout_ms = 0;
+    long kill_after_requests = 0;
+    char *trace_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "qs:d:W:T:Ro:r:t:w:fPF:M:H:K:X:")) != -1) {
+        switch (opt) {
+            case 'q': verbose = 0; break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'd': max_dwell_ms = atoi(optarg); break;
+            case 'W': wait_strategy = parse_wait_strategy(optarg); break;
+            case 'T': request_timeout_ms = atoi(optarg); break;
+            case 'R': reroute_on_timeout = 1; break;
+            case 'o': results_path = optarg; break;
+            case 'r': open_mode = 1; arrival_rate = atof(optarg); break;
+            case 't': duration_s = atof(optarg); break;
+            case 'w': warmup_s = atof(optarg); break;
+            case 'f': fixed_arrivals = 1; break;
+            case 'P': procedural_routes = 1; break;
+            case 'F': routes_path = optarg; break;
+            case 'M': num_monitors = atoi(optarg); break;
+            case 'H': heartbeat_timeout_ms = atoi(optarg); break;
+            case 'K': kill_after_requests = atol(optarg); break;
+            case 'X': trace_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
     // doesn't have the right number of arguments
-    //printf("tudo alocado dboas");
-    if (argc != 3) {
-        printf("Usage : %s <nombre1> <nombre2>\n", argv[0]);
+    if (argc - optind != 2 || max_dwell_ms < 1 || wait_strategy < 0 || request_timeout_ms < 0 || num_monitors < 0 || heartbeat_timeout_ms < 0 || kill_after_requests < 0 || (kill_after_requests && !heartbeat_timeout_ms) || (open_mode && (arrival_rate <= 0 || duration_s <= warmup_s || warmup_s < 0 || routes_path))) {
+        usage(argv[0]);
         return 1; 
     }
 
-    srand(time(NULL));
-    int number_sectors = atoi(argv[1]);
-    int number_aeronaves = atoi(argv[2]);
-    int max_tam_rota = number_sectors*2; // max route size arbitrarily defined as this
+    srand(seed);
+    int number_sectors = atoi(argv[optind]);
+    int number_aeronaves = atoi(argv[optind + 1]);
+    max_tam_rota = number_sectors*2; // max route size arbitrarily defined as this
     // initialize structures
-    sectors = malloc(sizeof(Sector*) * number_sectors);
-    aeronaves = malloc(sizeof(Aeronave*) * number_aeronaves);
-    centralized_control_mechanism = create_centralized_control_mechanism(number_sectors, number_aeronaves); // use sectors count
-
-    thread_returns = malloc(sizeof(int) * number_aeronaves);
-    n_threads = number_aeronaves;
-    for (int i = 0; i < number_aeronaves; i++) {
-        thread_returns[i] = 0;
-    } 
-
-    for (int i = 0; i < number_sectors; i++) {
-        sectors[i] = create_sector(i);
+    simulation = create_simulation(number_sectors, number_aeronaves, seed);
+    if (!simulation) {
+        printf("Error: can't create the simulation\n");
+        return 1;
     }
-    
+    simulation->ccm->max_dwell_ms = max_dwell_ms;
+    simulation->ccm->verbose = verbose;
+    simulation->ccm->wait_strategy = (WaitStrategy)wait_strategy;
+    simulation->ccm->request_timeout_ms = request_timeout_ms;
+    simulation->ccm->reroute_on_timeout = reroute_on_timeout;
+    simulation->procedural_routes = procedural_routes;
+
     for (int j = 0; j < number_aeronaves; j++) {
-        aeronaves[j] = create_aeronave(j, rand() % 1000, rand() % max_tam_rota + 1);
+        if (open_mode) simulation->aeronaves[j] = create_aeronave(simulation, j, rand() % 1000, max_tam_rota); // rota big enough for any reuse
+        else simulation->aeronaves[j] = create_aeronave(simulation, j, rand() % 1000, rand() % max_tam_rota + 1);
     }                                      // random priority,   random route size
+    if (routes_path) {
+        int loaded = load_routes_file(simulation, routes_path);
+        if (loaded < 0) {
+            printf("Error: can't load the routes of %s\n", routes_path);
+            destroy_simulation(simulation);
+            return 1;
+        }
+        if (verbose) printf("%d routes loaded from %s\n", loaded, routes_path);
+    }
 
     // initialize threads
     pthread_t * aeronaves_threads = malloc(sizeof(pthread_t) * number_aeronaves);
     pthread_t centralized_control_mechanism_thread;
+    inject_ns = malloc(sizeof(uint64_t) * number_aeronaves);
+    latency_histogram_init(&flight_latency);
+    start_ns = monotonic_ns();
+#ifndef TRACEPOINTS
+    if (trace_path) {
+        printf("Error: -X needs the tracepoints, build with make clean && make TRACE=1\n");
+        destroy_simulation(simulation);
+        return 1;
+    }
+#endif
+    if (trace_path) {
+        simulation->ccm->tracer = create_tracer(TRACE_DEFAULT_CAPACITY);
+        if (!simulation->ccm->tracer) {
+            printf("Error: can't create the tracer\n");
+            destroy_simulation(simulation);
+            return 1;
+        }
+    }
+    pthread_t standby_thread;
+    if (heartbeat_timeout_ms > 0) {
+        Replication *replication = create_replication(simulation, heartbeat_timeout_ms);
+        if (!replication) {
+            printf("Error: can't create the standby CCM\n");
+            return 1;
+        }
+        replication->kill_after_requests = kill_after_requests;
+        pthread_create(&standby_thread, NULL, thread_standby_function, NULL);
+    }
     pthread_create(&centralized_control_mechanism_thread, NULL, thread_centralized_control_mechanism, NULL);
+    monitors = calloc(num_monitors > 0 ? num_monitors : 1, sizeof(Monitor));
+    for (int m = 0; m < num_monitors; m++) {
+        pthread_create(&monitors[m].thread, NULL, thread_monitor_function, &monitors[m]);
+    }
+
+    if (open_mode) {
+        free_slots = malloc(sizeof(int) * number_aeronaves);
+        for (int j = 0; j < number_aeronaves; j++) free_slots[j] = number_aeronaves - 1 - j; // slot 0 is used first
+        num_free_slots = number_aeronaves;
+        warmup_end_ns = start_ns + (uint64_t)(warmup_s * 1e9);
+        end_ns = start_ns + (uint64_t)(duration_s * 1e9);
 
-    for(int j = 0; j < number_aeronaves; j++) {
-        pthread_create(&aeronaves_threads[j], NULL,
-                       thread_aeronave_function, (void *)aeronaves[j]);   // function uses real pointer now
+        pthread_t injector_thread;
+        pthread_create(&injector_thread, NULL, thread_injector_function, (void *)aeronaves_threads);
+        pthread_join(injector_thread, NULL);
     }
-    
-    for(int j = 0; j < number_aeronaves; j++) {
-        pthread_join(aeronaves_threads[j], NULL);
+    else {
+        warmup_end_ns = start_ns; // every flight counts
+        end_ns = UINT64_MAX;
+        for(int j = 0; j < number_aeronaves; j++) {
+            inject_ns[j] = start_ns;
+            pthread_create(&aeronaves_threads[j], NULL,
+                           thread_aeronave_function, (void *)simulation->aeronaves[j]);   // function uses real pointer now
+        }
+        
+        for(int j = 0; j < number_aeronaves; j++) {
+            pthread_join(aeronaves_threads[j], NULL);
+        }
+    }
+    monitors_stop = 1;
+    uint64_t monitored_ns = monotonic_ns() - start_ns;
+    long snapshots = 0, snapshot_retries = 0, inconsistent = 0;
+    uint64_t snapshot_ns = 0;
+    for (int m = 0; m < num_monitors; m++) {
+        pthread_join(monitors[m].thread, NULL);
+        snapshots += monitors[m].snapshots;
+        snapshot_retries += monitors[m].retries;
+        inconsistent += monitors[m].inconsistent;
+        snapshot_ns += monitors[m].ns;
     }
+    free(monitors);
+    simulation->stop = 1; // every aeronave has finished: the CCM processes the requests still queued, then stops
     pthread_join(centralized_control_mechanism_thread, NULL);
+    if (heartbeat_timeout_ms > 0) pthread_join(standby_thread, NULL);
+
+    double window_s = open_mode ? duration_s - warmup_s : (monotonic_ns() - start_ns) / 1e9;
+    double throughput = completed_in_window / window_s;
+    uint64_t wait_ns = 0, waits = 0;
+    for (int j = 0; j < number_aeronaves; j++) {
+        wait_ns += simulation->aeronaves[j]->wait_ns_total;
+        waits += simulation->aeronaves[j]->waits;
+        timeouts += simulation->aeronaves[j]->timeouts;
+    }
+    mean_wait_us = waits ? wait_ns / 1e3 / waits : 0;
+    struct rusage usage_self;
+    getrusage(RUSAGE_SELF, &usage_self);
+    cpu_s = usage_self.ru_utime.tv_sec + usage_self.ru_utime.tv_usec / 1e6
+          + usage_self.ru_stime.tv_sec + usage_self.ru_stime.tv_usec / 1e6;
+    if (open_mode) {
+        printf("\n[OPEN_MODE] %.1f aeronaves/s (%s) during %.1fs, warmup %.1fs\n",
+               arrival_rate, fixed_arrivals ? "fixed" : "poisson", duration_s, warmup_s);
+        printf("[OPEN_MODE] Arrivals: %ld, dropped (no free aeronave): %ld\n", arrivals, dropped_arrivals);
+        printf("[OPEN_MODE] Steady state: %ld flights ended, throughput %.2f aeronaves/s\n",
+               completed_in_window, throughput);
+    }
+    else {
+        printf("\n[RESULTS] %ld flights ended in %.3fs, throughput %.2f aeronaves/s\n",
+               completed_in_window, window_s, throughput);
+    }
+    printf("[RESULTS] Flight latency (ms): mean %.3f, p50 %.3f, p99 %.3f, max %.3f\n",
+           latency_histogram_mean(&flight_latency) / 1e6,
+           latency_histogram_percentile(&flight_latency, 50) / 1e6,
+           latency_histogram_percentile(&flight_latency, 99) / 1e6,
+           flight_latency.max_ns / 1e6);
+    printf("[RESULTS] Wait for the CCM (%s): mean %.3f us over %llu waits, cpu time %.3fs (%.2f cores busy)\n",
+           wait_strategy_name(simulation->ccm->wait_strategy), mean_wait_us, (unsigned long long)waits,
+           cpu_s, cpu_s / ((monotonic_ns() - start_ns) / 1e9));
+    for (int t = 0; t < NUM_SERVICE_TIERS; t++) {
+        LatencyHistogram *grant = &simulation->ccm->grant_latency[t];
+        printf("[RESULTS] Grant latency tier %d (us): %llu grants, p50 %.3f, p99 %.3f, max %.3f\n", t,
+               (unsigned long long)grant->total, latency_histogram_percentile(grant, 50) / 1e3,
+               latency_histogram_percentile(grant, 99) / 1e3, grant->max_ns / 1e3);
+    }
+    if (request_timeout_ms > 0) {
+        printf("[RESULTS] Requests timed out after %d ms: %llu (%s)\n", request_timeout_ms, (unsigned long long)timeouts,
+               reroute_on_timeout ? "rerouted" : "retried");
+    }
+    // the CCM has stopped: its bitmaps must say every sector is free, and match the sectors
+    printf("[RESULTS] Sectors at the end: %d occupied, %d with a waiting list, %d out of sync with the bitmaps\n",
+           count_occupied_sectors(simulation->ccm), count_waiting_sectors(simulation->ccm), check_sector_bitmaps(simulation));
+    Replication *replication = simulation->ccm->replication;
+    if (replication) {
+        printf("[STANDBY] Replication: %llu events (%.2f per request), the CCM waited %llu times for the standby\n",
+               (unsigned long long)replication->events_total,
+               replication->requests ? (double)replication->events_total / replication->requests : 0,
+               (unsigned long long)replication->log_full_waits);
+        if (replication->failovers) {
+            printf("[STANDBY] Failover after %ld requests: no CCM for %.3f ms (heartbeat timeout %d ms), "
+                   "takeover %.1f us with %llu events replayed\n", replication->requests,
+                   replication->failover_silence_ns / 1e6, heartbeat_timeout_ms,
+                   replication->failover_takeover_ns / 1e3, (unsigned long long)replication->replayed_at_takeover);
+        }
+    }
+    if (trace_path) {
+        Tracer *tracer = simulation->ccm->tracer;
+        long written = write_trace(tracer, trace_path);
+        if (written < 0) printf("[TRACE] Error: can't write %s\n", trace_path);
+        else printf("[TRACE] %ld events written to %s (%ld dropped, capacity %ld)\n", written, trace_path,
+                    tracer->next > tracer->capacity ? tracer->next - tracer->capacity : 0, tracer->capacity);
+    }
+    if (num_monitors > 0) {
+        printf("[MONITOR] %d monitor(s): %ld snapshots of %d sectors, %.0f snapshots/s, %.1f ns per snapshot, "
+               "%.3f retries per snapshot, %ld inconsistent\n", num_monitors, snapshots, number_sectors,
+               snapshots / (monitored_ns / 1e9), snapshots ? (double)snapshot_ns / snapshots : 0,
+               snapshots ? (double)snapshot_retries / snapshots : 0, inconsistent);
+    }
+    if (results_path) write_results_csv(results_path, number_sectors, number_aeronaves, seed, window_s, throughput);
+    free(inject_ns);
+    if (open_mode) free(free_slots);
 
     free(aeronaves_threads);
-    free(thread_returns);
-    // TODO : really use the destroy functions
-    free(sectors);
-    free(aeronaves);
-    destroy_centralized_control_mechanism(centralized_control_mechanism);
-    printf("Main thread finished\n");
+    destroy_simulation(simulation);
+    if (verbose) printf("Main thread finished\n");
     return 0; 
-}    
\ No newline at end of file
+}
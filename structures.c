@@ -3,13 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>   // usleep
-#include <string.h> // (may be useful)
-#include <errno.h>   // EBUSY for pthread_mutex_trylock return
+#include <string.h> // memset
+#include <errno.h>   // ERANGE for strtol
 #include <time.h>  //sleep for random time
+#include <sched.h> // sched_yield
 
-extern Sector **sectors;
-extern Aeronave **aeronaves;
-extern CentralizedControlMechanism *centralized_control_mechanism;
 
 
 // Sector functions
@@ -106,44 +104,210 @@ int is_full_sectors(Sector * sectors, int number_sectors) {
 }
 
 // Aeronave functions
-Aeronave* create_aeronave(int id, int priority, int tam_rota) {
+// mixes the seed of a procedural route with the index of a hop (murmur3 finalizer)
+static unsigned int route_hash(unsigned int seed, int index) {
+    unsigned int h = seed ^ ((unsigned int)index * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// hop `index` of a procedural route, from the hop before it (two consecutive sectors are always different)
+static int route_next_hop(unsigned int seed, int index, int prev, int num_sectors) {
+    if (index == 0 || prev < 0) return route_hash(seed, index) % num_sectors;
+    if (num_sectors < 2) return 0;
+    return (prev + 1 + route_hash(seed, index) % (num_sectors - 1)) % num_sectors;
+}
+
+// Returns the sector at position `index` of the route of the aeronave
+// (a procedural route is generated again from its seed, only the next hop of the aeronave is kept)
+int aeronave_route_sector(Simulation * sim, Aeronave * aeronave, int index) {
+    if (!aeronave || index < 0 || index >= aeronave->tam_rota) return -1;
+    if (aeronave->rota) return aeronave->rota[index];
+    if (index < aeronave->route_hop_index) { // going back: start again from the first hop
+        aeronave->route_hop_index = 0;
+        aeronave->route_hop = route_next_hop(aeronave->route_seed, 0, -1, sim->number_sectors);
+    }
+    while (aeronave->route_hop_index < index) {
+        aeronave->route_hop_index++;
+        aeronave->route_hop = route_next_hop(aeronave->route_seed, aeronave->route_hop_index, aeronave->route_hop, sim->number_sectors);
+    }
+    return aeronave->route_hop;
+}
+
+static void print_rota(Simulation * sim, Aeronave * a) {
+    if (!sim->ccm->verbose) return;
+    printf("Aeronave %d started, priority level: %d\n", a->id, a->priority);           // updated variable name
+    if (a->rota) printf("Route size: %d\n", a->tam_rota);
+    else printf("Route size: %d (procedural, seed %u)\n", a->tam_rota, a->route_seed);
+    for(int i = 0; i < a->tam_rota; i++){
+            printf("%d -> ", aeronave_route_sector(sim, a, i));
+    }
+    aeronave_route_sector(sim, a, 0); // back to the first hop
+    printf("\n");
+    printf("\n");
+}
+
+// a procedural route is only its seed and its length, the first hop is generated now and the others when they are needed
+static void generate_procedural_rota(Simulation * sim, Aeronave * a) {
+    a->route_seed = (unsigned int)rand_r(&sim->seed);
+    a->route_hop_index = 0;
+    a->route_hop = route_next_hop(a->route_seed, 0, -1, sim->number_sectors);
+    print_rota(sim, a);
+}
+
+// fills a->rota with a random route of a->tam_rota sectors (two consecutive sectors have to be different) and prints it
+static void generate_rota(Simulation * sim, Aeronave * a) {
+    int num_sectors = sim->number_sectors;
+    a->rota[0] = rand_r(&sim->seed) % num_sectors; // random starting sector
+    int next;
+    int i = 1;
+    while(i < a->tam_rota){
+        next = rand_r(&sim->seed) % num_sectors;
+        if(next != a->rota[i-1]){ // selects a random route, and two consecutive sectors have to be different
+            a->rota[i] = next;
+            i++;
+        }
+    }
+    print_rota(sim, a);
+}
+
+Aeronave* create_aeronave(Simulation * sim, int id, int priority, int tam_rota) {
     Aeronave* a = malloc(sizeof(Aeronave));
     if (!a) return NULL;
     
     a->id = id;
     a->priority = priority;
     a->tam_rota = tam_rota;
+    a->rota_capacity = 0;
     a->current_index_rota = 0;
     a->aguardar = 0;
-    
+    a->rand_state = (unsigned int)rand_r(&sim->seed); // the aeronave thread has its own random sequence
+    a->spin_budget_ns = SPIN_BUDGET_INITIAL_NS;
+    a->avg_wait_ns = SPIN_BUDGET_INITIAL_NS / 2;
+    a->wait_ns_total = 0;
+    a->waits = 0;
+    a->wait_result = WAIT_GRANTED;
+    a->timeouts = 0;
+    a->request_ns = 0;
+    a->requested_sector = -1;
+    a->rota = NULL;
+    a->current_sector = NULL; //starting sector has to be undefined, because it has to wait for the permission of control 
+
+    if (sim->procedural_routes) {
+        generate_procedural_rota(sim, a);
+        return a;
+    }
+
     // CRITICAL: Allocate memory for the rota array
     a->rota = malloc(sizeof(int) * tam_rota);
     if (!a->rota) {
         free(a);
         return NULL;
     }
+    a->rota_capacity = tam_rota;
     
-    int num_sectors = centralized_control_mechanism->num_mutex_sections;
-    a->rota[0] = rand() % num_sectors; // random starting sector
-    int next;
-    int i = 1;
-    while(i < tam_rota){
-        next = rand() % num_sectors;
-        if(next != a->rota[i-1]){ // selects a random route, and two consecutive sectors have to be different
-            a->rota[i] = next;
-            i++;
-        }
+    generate_rota(sim, a);
+    return a;
+}
+
+// Recycles a finished aeronave (same id, semaphore and rota storage) for a new flight
+// Returns 0 on success, -1 if the aeronave is still flying or the route doesn't fit in its rota array
+int reset_aeronave(Simulation * sim, Aeronave * aeronave, int priority, int tam_rota) {
+    if (!aeronave) return -1;
+    if (aeronave->current_sector != NULL) return -1;
+    if (tam_rota < 1) return -1;
+    if (sim->procedural_routes) { // an explicit route (from a routes file) is only used by the first flight
+        free(aeronave->rota);
+        aeronave->rota = NULL;
+        aeronave->rota_capacity = 0;
     }
-    a->current_sector = NULL; //starting sector has to be undefined, because it has to wait for the permission of control 
-    printf("Aeronave %d started, priority level: %d\n", a->id, a->priority);           // updated variable name
-    printf("Route size: %d\n", a->tam_rota);
-    for(int i = 0; i < a->tam_rota; i++){
-            printf("%d -> ", a->rota[i]);
+    else if (!aeronave->rota || tam_rota > aeronave->rota_capacity) return -1;
+
+    aeronave->priority = priority;
+    aeronave->tam_rota = tam_rota;
+    aeronave->current_index_rota = 0;
+    aeronave->aguardar = 0;
+    if (aeronave->rota) generate_rota(sim, aeronave);
+    else generate_procedural_rota(sim, aeronave);
+    return 0;
+}
+
+// Gives the aeronave an explicit route (copied, the rota array grows if needed)
+// Returns 0 on success, -1 if a sector doesn't exist or two consecutive sectors are the same
+int set_aeronave_rota(Simulation * sim, Aeronave * aeronave, const int * rota, int tam_rota) {
+    if (!aeronave || !rota || tam_rota < 1) return -1;
+    if (aeronave->current_sector != NULL) return -1;
+    for (int i = 0; i < tam_rota; i++) {
+        if (rota[i] < 0 || rota[i] >= sim->number_sectors) return -1;
+        if (i > 0 && rota[i] == rota[i-1]) return -1;
     }
-    printf("\n");
-    printf("\n");
+    if (tam_rota > aeronave->rota_capacity) {
+        int *bigger = realloc(aeronave->rota, sizeof(int) * tam_rota);
+        if (!bigger) return -1;
+        aeronave->rota = bigger;
+        aeronave->rota_capacity = tam_rota;
+    }
+    memcpy(aeronave->rota, rota, sizeof(int) * tam_rota);
+    aeronave->tam_rota = tam_rota;
+    aeronave->current_index_rota = 0;
+    print_rota(sim, aeronave);
+    return 0;
+}
 
-    return a;
+// Reads one route per line (sector ids separated by spaces or commas) and gives line i to aeronave i,
+// the aeronaves after the last line keep their generated route
+// Returns the number of routes loaded, -1 if the file can't be read or a route is invalid
+int load_routes_file(Simulation * sim, const char * path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char *line = NULL;
+    size_t line_size = 0;
+    int *rota = NULL;
+    int rota_size = 0;
+    int loaded = 0;
+    while (loaded < sim->number_aeronaves && getline(&line, &line_size, f) != -1) {
+        int tam_rota = 0;
+        for (char *tok = strtok(line, " ,\t\r\n"); tok != NULL; tok = strtok(NULL, " ,\t\r\n")) {
+            if (tam_rota == rota_size) {
+                int *bigger = realloc(rota, sizeof(int) * (rota_size ? rota_size * 2 : 16));
+                if (!bigger) {
+                    printf("Error: out of memory reading %s\n", path);
+                    tam_rota = -1;
+                    break;
+                }
+                rota = bigger;
+                rota_size = rota_size ? rota_size * 2 : 16;
+            }
+            char *end;
+            errno = 0;
+            long sector = strtol(tok, &end, 10);
+            if (*end != '\0' || errno == ERANGE || sector < 0 || sector >= sim->number_sectors) {
+                printf("Error: invalid sector '%s' in the route of aeronave %d in %s\n", tok, loaded, path);
+                tam_rota = -1;
+                break;
+            }
+            rota[tam_rota++] = (int)sector;
+        }
+        if (tam_rota < 0) {
+            loaded = -1;
+            break;
+        }
+        if (tam_rota == 0) continue; // empty line
+        if (set_aeronave_rota(sim, sim->aeronaves[loaded], rota, tam_rota) < 0) {
+            printf("Error: invalid route for aeronave %d in %s\n", loaded, path);
+            loaded = -1;
+            break;
+        }
+        loaded++;
+    }
+    free(rota);
+    free(line);
+    fclose(f);
+    return loaded;
 }
 
 void destroy_aeronave(Aeronave * aeronave) {
@@ -155,36 +319,118 @@ void destroy_aeronave(Aeronave * aeronave) {
     }
 }
 
-int request_sector(Aeronave * aeronave, int id_sector) {
+int request_sector(Simulation * sim, Aeronave * aeronave, int id_sector) {
     // NAO PRECISA DO MUTEX !! JA USADO NO ENQUEUE_REQUEST FONCTION
     // insert a struct request in the request queue with the focntion int enqueue_request(CentralizedControlMechanism * ccm, RequestSector * request);
     // wait until the request is processed by the centralized control mechanism thread
     RequestSector req;
     req.id_aeronave = aeronave->id;
     req.id_sector   = id_sector;
-    req.request_type = 0;
+    if (aeronave->current_sector != NULL) {
+        // handoff: a single message tells the CCM to move the aeronave from its current sector to id_sector
+        req.request_type = 2;
+        req.id_sector_from = aeronave->current_sector->id;
+    }
+    else {
+        req.request_type = 0;
+        req.id_sector_from = -1;
+    }
+    aeronave->request_ns = monotonic_ns();
+    aeronave->requested_sector = id_sector;
+    req.deadline_ns = sim->ccm->request_timeout_ms > 0 ? aeronave->request_ns + (uint64_t)sim->ccm->request_timeout_ms * 1000000ull : 0;
+    req.tier = service_tier(aeronave->priority);
+    if (req.request_type == 2) {
+        // a handoff also frees id_sector_from: it goes in the lane of the first aeronave waiting for that sector if
+        // it's a higher one, or a low priority aeronave would hold it up (the published value may be a request late)
+        int waiter_tier = __atomic_load_n(&sim->ccm->airspace[req.id_sector_from].first_waiter_tier, __ATOMIC_RELAXED);
+        if (waiter_tier < req.tier) req.tier = waiter_tier;
+    }
     aeronave->aguardar = 1; // before sending request (if it requests before, ccm can change it's attribute before entering wait_sector function)
-    return enqueue_request(centralized_control_mechanism, &req);
+    return enqueue_request(sim->ccm, &req);
+}
+
+// tells the cpu we are spinning (lets the other hyperthread run), no-op where there is no such instruction
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// spin-then-park: spins on the semaphore for at most aeronave->spin_budget_ns, then blocks in sem_wait (a futex wait)
+static void wait_spin_then_park(Aeronave * aeronave, sem_t * sem, uint64_t start) {
+    uint64_t deadline = start + aeronave->spin_budget_ns;
+    do {
+        if (sem_trywait(sem) == 0) return;
+        cpu_relax();
+    } while (monotonic_ns() < deadline);
+    sem_wait(sem);
+}
+
+// after each wait the spin budget follows the average wait: spinning only pays off if the grant usually comes
+// before the end of the budget, so when the waits get longer than SPIN_BUDGET_MAX_NS the aeronave goes back to
+// parking almost immediately
+static void adapt_spin_budget(Aeronave * aeronave, uint64_t waited_ns) {
+    int64_t delta = (int64_t)waited_ns - (int64_t)aeronave->avg_wait_ns;
+    aeronave->avg_wait_ns = (uint64_t)((int64_t)aeronave->avg_wait_ns + delta / 8); // moving average, weight 1/8
+    uint64_t budget = 2 * aeronave->avg_wait_ns;
+    aeronave->spin_budget_ns = budget <= SPIN_BUDGET_MAX_NS ? (budget > SPIN_BUDGET_MIN_NS ? budget : SPIN_BUDGET_MIN_NS)
+                                                            : SPIN_BUDGET_MIN_NS;
 }
 
 // if the response of the request is NULL, the aeronave must wait
-int wait_sector(Aeronave * aeronave) {
-    printf("\033[34m[AIRCRAFT %d] Started waiting\033[0m\n", aeronave->id);
-    sem_wait(&centralized_control_mechanism->semaphores_aeronaves[aeronave->id]);
-    printf("\033[34m[AIRCRAFT %d] Is free\033[0m\n", aeronave->id);
-    return 0;
+// how it waits for the CCM depends on sim->ccm->wait_strategy
+// Returns WAIT_GRANTED, or WAIT_TIMED_OUT if the deadline of the request passed (the aeronave is no longer in the waiting list)
+int wait_sector(Simulation * sim, Aeronave * aeronave) {
+    LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Started waiting\033[0m\n", aeronave->id);
+    sem_t *sem = &sim->ccm->semaphores_aeronaves[aeronave->id];
+    uint64_t start = monotonic_ns();
+    switch (sim->ccm->wait_strategy) {
+        case WAIT_BUSY_POLL:
+            while (sem_trywait(sem) != 0) cpu_relax();
+            break;
+        case WAIT_SPIN_PARK:
+            wait_spin_then_park(aeronave, sem, start);
+            break;
+        default:
+            sem_wait(sem);
+            break;
+    }
+    uint64_t waited = monotonic_ns() - start;
+    if (sim->ccm->wait_strategy == WAIT_SPIN_PARK) adapt_spin_budget(aeronave, waited);
+    aeronave->wait_ns_total += waited;
+    aeronave->waits++;
+    int result = aeronave->wait_result; // written by the CCM before sem_post
+    TRACE(sim->ccm, TRACE_WAKE, aeronave->id, aeronave->requested_sector, result);
+    aeronave->wait_result = WAIT_GRANTED;
+    if (result == WAIT_TIMED_OUT) {
+        aeronave->timeouts++;
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Request timed out\033[0m\n", aeronave->id);
+    }
+    else {
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Is free\033[0m\n", aeronave->id);
+    }
+    return result;
+}
+
+// pause between two acquire_sector() tries, as long as the previous aeronave hasn't unlocked the sector
+static void acquire_backoff(Simulation * sim) {
+    switch (sim->ccm->wait_strategy) {
+        case WAIT_BUSY_POLL: cpu_relax(); break;
+        case WAIT_SPIN_PARK: sched_yield(); break;
+        default: usleep(100); break;
+    }
 }
 
 // if the response of the request is a Sector*, the aeronave can acquire it
-int acquire_sector(Aeronave * aeronave, Sector * sector) {
-    if (!centralized_control_mechanism || !sector) return 0;
+int acquire_sector(Simulation * sim, Aeronave * aeronave, Sector * sector) {
+    if (!sim || !sector) return 0;
     int sid = sector->id;
-    if (sid < 0 || sid >= centralized_control_mechanism->num_mutex_sections) return 0;
+    if (sid < 0 || sid >= sim->ccm->num_mutex_sections) return 0;
 
-    MutexPriority *mp = centralized_control_mechanism->mutex_sections[sid];
-    int rc = pthread_mutex_trylock(&mp->mutex_sector);
-    if (rc == 0) {
-        printf("\033[34m[AIRCRAFT %d] Acquired sector %d\033[0m\n", aeronave->id, sector->id);
+    MutexPriority *mp = sim->ccm->mutex_sections[sid];
+    if (sem_trywait(&mp->sector_lock) == 0) {
+        TRACE(sim->ccm, TRACE_ACQUIRE, aeronave->id, sid, 0);
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Acquired sector %d\033[0m\n", aeronave->id, sector->id);
         aeronave->current_sector = sector;
         aeronave->current_index_rota++;
         return 1;
@@ -192,85 +438,198 @@ int acquire_sector(Aeronave * aeronave, Sector * sector) {
     return 0;
 }
 
-Sector* release_sector(Aeronave * aeronave, Sector* to_release) {
-    if (!centralized_control_mechanism || !aeronave || !to_release) return NULL;
+// Only unlocks the sector, without warning the CCM (used after a handoff, the CCM already knows the sector is free)
+Sector* unlock_sector(Simulation * sim, Aeronave * aeronave, Sector* to_release) {
+    if (!sim || !aeronave || !to_release) return NULL;
     int sid = to_release->id;
-    if (sid < 0 || sid >= centralized_control_mechanism->num_mutex_sections) return NULL;
+    if (sid < 0 || sid >= sim->ccm->num_mutex_sections) return NULL;
 
-    MutexPriority *mp = centralized_control_mechanism->mutex_sections[sid];
-    pthread_mutex_unlock(&mp->mutex_sector);
+    MutexPriority *mp = sim->ccm->mutex_sections[sid];
+    sem_post(&mp->sector_lock);
+    TRACE(sim->ccm, TRACE_RELEASE, aeronave->id, sid, 0);
     // Only set current_sector to NULL if we're releasing the current sector
-    if (aeronave->current_sector->id == to_release->id) {
+    if (aeronave->current_sector != NULL && aeronave->current_sector->id == to_release->id) {
         aeronave->current_sector = NULL;
     }
+    LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Released sector %d\033[0m\n", aeronave->id, sid);
+    return to_release;
+}
+
+Sector* release_sector(Simulation * sim, Aeronave * aeronave, Sector* to_release) {
+    if (unlock_sector(sim, aeronave, to_release) == NULL) return NULL;
     RequestSector req;
     req.id_aeronave = aeronave->id;
-    req.id_sector   = sid;
+    req.id_sector   = to_release->id;
     req.request_type = 1;
-    printf("\033[34m[AIRCRAFT %d] Released sector %d\033[0m\n", aeronave->id, sid);
-    enqueue_request(centralized_control_mechanism, &req); // sends a request warning that the sector is free
+    req.id_sector_from = -1;
+    req.deadline_ns = 0;
+    req.tier = 0; // releases free sectors for everyone, they go first
+    // sends a request warning that the sector is free; it can't be dropped (the sector would never be free again),
+    // so on a full lane it waits for the CCM to make room
+    while (enqueue_request(sim->ccm, &req) != 0) {
+        usleep(100);
+    }
     return to_release;
 }
 
 int repeat(Aeronave * aeronave) {
-    if (!aeronave || !aeronave->rota) return 0;
+    if (!aeronave) return 0;
     return (aeronave->current_index_rota < aeronave->tam_rota); // if it was at the last sector, exit
 }
 
+// after a timeout, replaces the next sector of the route by another one (different from the sector that timed out and
+// from the sector after it; the aeronave holds no sector, the CCM released it when the request started waiting).
+// The hops after it of a procedural route are generated from the new one, and the route is never rewound: that would
+// regenerate it from the seed and undo the previous reroutes
+// Returns the new sector, -1 if the route wasn't changed
+int reroute_aeronave(Simulation * sim, Aeronave * aeronave) {
+    int i = aeronave->current_index_rota;
+    int old = aeronave_route_sector(sim, aeronave, i); // index i is the next hop: a procedural route is already there
+    if (old < 0) return -1;
+    int after = aeronave->rota && i + 1 < aeronave->tam_rota ? aeronave->rota[i+1] : -1;
+    for (int tries = 0; tries < 8; tries++) {
+        int next = rand_r(&aeronave->rand_state) % sim->number_sectors;
+        if (next != old && next != after) {
+            if (aeronave->rota) aeronave->rota[i] = next;
+            else aeronave->route_hop = next;
+            LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Rerouted from sector %d to sector %d\033[0m\n", aeronave->id, old, next);
+            return next;
+        }
+    }
+    return -1;
+}
+
 // Pequena função interna para obter o próximo setor da rota (terminada com -1)
-static int aeronave_next_sector_id(Aeronave *a) {
-    if (!a || !a->rota) return -1;
-    return a->rota[a->current_index_rota];
+static int aeronave_next_sector_id(Simulation * sim, Aeronave *a) {
+    if (!a) return -1;
+    return aeronave_route_sector(sim, a, a->current_index_rota);
 }
 
 // "Init + run": prepara estado e executa a rota completa da aeronave
-void init_aeronave(Aeronave * aeronave) {
+void init_aeronave(Simulation * sim, Aeronave * aeronave) {
     if (!aeronave) return;
 
     if (aeronave->current_index_rota < 0) aeronave->current_index_rota = 0;
 
     while (repeat(aeronave)) {
         if(aeronave->current_sector != NULL){
-            printf("\033[34m[AIRCRAFT %d] Currently at sector %d\033[0m\n", aeronave->id, aeronave->current_sector->id);
+            LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Currently at sector %d\033[0m\n", aeronave->id, aeronave->current_sector->id);
         }
         else{
-            printf("\033[34m[AIRCRAFT %d] Route not started\033[0m\n", aeronave->id);
+            LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Route not started\033[0m\n", aeronave->id);
         }
-        int next_id = aeronave_next_sector_id(aeronave);
+        int next_id = aeronave_next_sector_id(sim, aeronave);
         if (next_id < 0) break;
 
         // Request access to the next sector
-        if (request_sector(aeronave, next_id) < 0) {
+        if (request_sector(sim, aeronave, next_id) < 0) {
             sleep(1);
             continue;
         }
 
         // Wait CCM authorization 
-        wait_sector(aeronave);
+        if (wait_sector(sim, aeronave) == WAIT_TIMED_OUT) {
+            // the CCM released our sector when it put us in the waiting list: nothing is held, wait a random time
+            // (so the aeronaves that timed out together don't come back together) and try again
+            if (sim->ccm->reroute_on_timeout) reroute_aeronave(sim, aeronave);
+            usleep(1000 * (rand_r(&aeronave->rand_state) % sim->ccm->request_timeout_ms + 1));
+            continue;
+        }
         Sector* to_release = aeronave->current_sector;
         
         // Acquire (trylock) after authorization it should be available
-        while (!acquire_sector(aeronave, sectors[next_id])) {
-            usleep(100);
+        while (!acquire_sector(sim, aeronave, sim->sectors[next_id])) {
+            acquire_backoff(sim);
         }
 
-        // releases sector
-        release_sector(aeronave, to_release);
-        printf("\033[34m[AIRCRAFT %d] Entered sector %d\033[0m\n", aeronave->id, aeronave->current_sector->id);
+        // unlocks the previous sector (the CCM already freed it when it processed the handoff request)
+        unlock_sector(sim, aeronave, to_release);
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Entered sector %d\033[0m\n", aeronave->id, aeronave->current_sector->id);
 
         // Simulate using the sector for a random time
-        usleep(1000 * (rand() % 5 + 1));
+        usleep(1000 * (rand_r(&aeronave->rand_state) % sim->ccm->max_dwell_ms + 1));
 
         // advance to next waypoint
         // printf("%d\n", aeronave->current_index_rota);
     }
     // Release last sector if we have one
     if (aeronave->current_sector != NULL) {
-        printf("\033[34m[AIRCRAFT %d] Currently at sector %d, finishing route.\033[0m\n", aeronave->id, aeronave->current_sector->id);
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Currently at sector %d, finishing route.\033[0m\n", aeronave->id, aeronave->current_sector->id);
         Sector* final_sector = aeronave->current_sector;
-        release_sector(aeronave, final_sector);
-        printf("\033[34m[AIRCRAFT %d] Left sector %d\033[0m\n", aeronave->id, final_sector->id);
+        release_sector(sim, aeronave, final_sector);
+        LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Left sector %d\033[0m\n", aeronave->id, final_sector->id);
+    }
+}
+
+// WaitStrategy names, used by the command line
+static const char *wait_strategy_names[] = {"block", "spin", "poll"};
+
+const char* wait_strategy_name(WaitStrategy strategy) {
+    return wait_strategy_names[strategy];
+}
+
+// Returns the strategy called name, -1 if there is none
+int parse_wait_strategy(const char * name) {
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, wait_strategy_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Time functions
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// LatencyHistogram functions
+// values below LATENCY_SUB_BUCKETS have their own bucket, above that each power of two is split in LATENCY_SUB_BUCKETS
+// linear buckets, so any percentile is given with less than 1/LATENCY_SUB_BUCKETS of relative error
+static int latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_SUB_BUCKETS) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns); // >= 4
+    int sub = (int)((ns >> (msb - 4)) & (LATENCY_SUB_BUCKETS - 1));
+    return (msb - 3) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// highest value that falls in the bucket
+static uint64_t latency_bucket_value(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return (uint64_t)bucket;
+    int msb = bucket / LATENCY_SUB_BUCKETS + 3;
+    uint64_t sub = (uint64_t)(bucket % LATENCY_SUB_BUCKETS);
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << (msb - 4)) - 1;
+}
+
+void latency_histogram_init(LatencyHistogram * histogram) {
+    memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+void latency_histogram_record(LatencyHistogram * histogram, uint64_t ns) {
+    histogram->counts[latency_bucket(ns)]++;
+    histogram->total++;
+    histogram->sum_ns += ns;
+    if (ns > histogram->max_ns) histogram->max_ns = ns;
+}
+
+// p between 0 and 100, returns 0 if nothing was recorded
+uint64_t latency_histogram_percentile(LatencyHistogram * histogram, double p) {
+    if (histogram->total == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)histogram->total);
+    if (rank >= histogram->total) rank = histogram->total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen > rank) {
+            uint64_t value = latency_bucket_value(i);
+            return value < histogram->max_ns ? value : histogram->max_ns;
+        }
     }
+    return histogram->max_ns;
+}
+
+uint64_t latency_histogram_mean(LatencyHistogram * histogram) {
+    return histogram->total ? histogram->sum_ns / histogram->total : 0;
 }
 
 RequestSector create_request(int number_sectors, int number_aeronaves) {
@@ -291,12 +650,12 @@ MutexPriority* create_mutex_priority(int max_size, int id){ // max size is the n
     mutex_priority->waiting_list = malloc(max_size * sizeof(Aeronave*));
     mutex_priority->max_size = max_size;
     mutex_priority->waiting_list_size = 0;
-    pthread_mutex_init(&mutex_priority->mutex_sector, NULL);
+    sem_init(&mutex_priority->sector_lock, 0, 1);
     return mutex_priority;
 }
 
 void destroy_mutex_priority(MutexPriority * mutex_priority){
-    pthread_mutex_destroy(&mutex_priority->mutex_sector);
+    sem_destroy(&mutex_priority->sector_lock);
     free(mutex_priority->waiting_list);
     free(mutex_priority);
 }
@@ -306,19 +665,28 @@ int order_list_by_priority(MutexPriority * mutex_priority){
     return 0; // i think it's not necessary (and would complicate a lot)
 }
 
-void insert_aeronave_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave){ // inserts the aeronaves by priority
+// Returns the position where the aeronave was inserted
+int insert_aeronave_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave){ // inserts the aeronaves by priority
     // since the centralized_control will call this function and it's managed by a single thread, there is no mutual exclusion here
     int n = mutex_priority->waiting_list_size;
     int i;
     for(i = 0; i < n; i++){
         if(mutex_priority->waiting_list[i]->priority < aeronave->priority){ // if they are equal, the order is preserved (the one that enters now will be added after the ones equal to it)
-            for(int j = n-1; j >= i; j--){ // open space for the aeronave that's entering
-                mutex_priority->waiting_list[j+1] = mutex_priority->waiting_list[j];
-            }
             break;
         }
     }
-    mutex_priority->waiting_list[i] = aeronave; // even if this aeronave priority is the lowest, i == n and the aeronave will enter by the end of the queue
+    insert_aeronave_at_mutex_priority(mutex_priority, aeronave, i); // even if this aeronave priority is the lowest, i == n and the aeronave will enter by the end of the queue
+    return i;
+}
+
+// inserts the aeronave at a given position, whatever its priority (used by the standby to copy the lists of the primary)
+void insert_aeronave_at_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave, int position){
+    int n = mutex_priority->waiting_list_size;
+    if(position < 0 || position > n) position = n;
+    for(int j = n-1; j >= position; j--){ // open space for the aeronave that's entering
+        mutex_priority->waiting_list[j+1] = mutex_priority->waiting_list[j];
+    }
+    mutex_priority->waiting_list[position] = aeronave;
     mutex_priority->waiting_list_size++;
 }
 
@@ -334,6 +702,23 @@ Aeronave* remove_aeronave_mutex_priority(MutexPriority * mutex_priority){
     mutex_priority->waiting_list[mutex_priority->waiting_list_size] = NULL; // cleans last position
     return out;
 }
+// Removes a specific aeronave from anywhere in the list (e.g. when its request times out), keeping the order of the others
+// Returns NULL if the aeronave isn't in the list
+Aeronave* remove_aeronave_by_id_mutex_priority(MutexPriority * mutex_priority, int id_aeronave){
+    int n = mutex_priority->waiting_list_size;
+    for(int i = 0; i < n; i++){
+        if(mutex_priority->waiting_list[i]->id == id_aeronave){
+            Aeronave *out = mutex_priority->waiting_list[i];
+            for(int j = i; j < n - 1; j++){
+                mutex_priority->waiting_list[j] = mutex_priority->waiting_list[j+1];
+            }
+            mutex_priority->waiting_list_size--;
+            mutex_priority->waiting_list[mutex_priority->waiting_list_size] = NULL;
+            return out;
+        }
+    }
+    return NULL;
+}
 int is_empty_mutex_priority(MutexPriority * mutex_priority){
     return mutex_priority->waiting_list_size == 0 ? 1 : 0;
 }
@@ -342,7 +727,209 @@ int is_full_mutex_priority(MutexPriority * mutex_priority){
 }
 
 
+// TimingWheel functions
+static void timer_unlink(TimerNode * timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+}
+
+// puts the timer in the slot of the level that covers its distance to the current tick
+// (timer->expires >= wheel->current_tick, a timer for the current tick goes to the slot being processed)
+static void timer_place(TimingWheel * wheel, TimerNode * timer) {
+    uint64_t delta = timer->expires - wheel->current_tick;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_SLOT_BITS * (level + 1)))) level++;
+    int slot = (int)((timer->expires >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1));
+    TimerNode *head = &wheel->slots[level][slot];
+    timer->next = head->next;
+    timer->prev = head;
+    head->next->prev = timer;
+    head->next = timer;
+}
+
+TimingWheel* create_timing_wheel(int num_timers, uint64_t start_ns) {
+    TimingWheel *wheel = malloc(sizeof(TimingWheel));
+    if (!wheel) return NULL;
+    wheel->timers = calloc(num_timers > 0 ? num_timers : 1, sizeof(TimerNode));
+    if (!wheel->timers) {
+        free(wheel);
+        return NULL;
+    }
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int i = 0; i < WHEEL_SLOTS; i++) {
+            wheel->slots[l][i].next = wheel->slots[l][i].prev = &wheel->slots[l][i];
+        }
+    }
+    for (int i = 0; i < num_timers; i++) wheel->timers[i].id_aeronave = i;
+    wheel->num_timers = num_timers;
+    wheel->current_tick = 0;
+    wheel->start_ns = start_ns;
+    wheel->armed_count = 0;
+    return wheel;
+}
+
+void destroy_timing_wheel(TimingWheel * wheel) {
+    if (!wheel) return;
+    free(wheel->timers);
+    free(wheel);
+}
+
+// Arms the timer of the aeronave (re-arms it if it was already armed)
+void timing_wheel_add(TimingWheel * wheel, int id_aeronave, int id_sector, uint64_t deadline_ns) {
+    TimerNode *timer = &wheel->timers[id_aeronave];
+    if (timer->armed) timing_wheel_cancel(wheel, id_aeronave);
+
+    uint64_t tick = deadline_ns > wheel->start_ns ? (deadline_ns - wheel->start_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS : 0;
+    uint64_t max_tick = wheel->current_tick + ((uint64_t)1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1;
+    if (tick <= wheel->current_tick) tick = wheel->current_tick + 1; // already late: expires at the next tick
+
+    timer->deadline = tick;
+    timer->expires = tick < max_tick ? tick : max_tick;
+    timer->id_sector = id_sector;
+    timer->armed = 1;
+    timer_place(wheel, timer);
+    wheel->armed_count++;
+}
+
+void timing_wheel_cancel(TimingWheel * wheel, int id_aeronave) {
+    TimerNode *timer = &wheel->timers[id_aeronave];
+    if (!timer->armed) return;
+    timer_unlink(timer);
+    timer->armed = 0;
+    wheel->armed_count--;
+}
+
+// moves the timers of the current slot of a level to the finer levels
+static void timer_cascade(TimingWheel * wheel, int level) {
+    int slot = (int)((wheel->current_tick >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1));
+    TimerNode *head = &wheel->slots[level][slot];
+    TimerNode *timer = head->next;
+    head->next = head->prev = head;
+    while (timer != head) {
+        TimerNode *next = timer->next;
+        timer_place(wheel, timer);
+        timer = next;
+    }
+}
+
+// Processes every tick up to now_ns, calling expire() for each timer that reached its deadline (the timer is
+// already disarmed when expire() is called). Returns the number of expired timers
+int timing_wheel_advance(TimingWheel * wheel, uint64_t now_ns, void (*expire)(TimerNode * timer, void * arg), void * arg) {
+    if (now_ns < wheel->start_ns) return 0;
+    uint64_t target = (now_ns - wheel->start_ns) / WHEEL_TICK_NS;
+    int expired = 0;
+    while (wheel->current_tick < target) {
+        if (wheel->armed_count == 0) { // nothing to expire: jump directly
+            wheel->current_tick = target;
+            break;
+        }
+        wheel->current_tick++;
+        // when a level wraps around, the next slot of the coarser level is spread on the finer ones
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if ((wheel->current_tick & (((uint64_t)1 << (WHEEL_SLOT_BITS * level)) - 1)) != 0) break;
+            timer_cascade(wheel, level);
+        }
+        TimerNode *head = &wheel->slots[0][wheel->current_tick & (WHEEL_SLOTS - 1)];
+        while (head->next != head) {
+            TimerNode *timer = head->next;
+            timer_unlink(timer);
+            if (timer->deadline > wheel->current_tick) { // beyond the range when it was added: not yet
+                uint64_t max_tick = wheel->current_tick + ((uint64_t)1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1;
+                timer->expires = timer->deadline < max_tick ? timer->deadline : max_tick;
+                timer_place(wheel, timer);
+                continue;
+            }
+            timer->armed = 0;
+            wheel->armed_count--;
+            expired++;
+            expire(timer, arg);
+        }
+    }
+    return expired;
+}
+
+// SectorBitmap functions
+// every query works a whole 64 bits word at a time, the bits after num_bits are always 0
+SectorBitmap* create_sector_bitmap(int num_bits) {
+    SectorBitmap *bitmap = malloc(sizeof(SectorBitmap));
+    if (!bitmap) return NULL;
+    bitmap->num_bits = num_bits;
+    bitmap->num_words = (num_bits + 63) / 64;
+    bitmap->words = calloc(bitmap->num_words > 0 ? bitmap->num_words : 1, sizeof(uint64_t));
+    if (!bitmap->words) {
+        free(bitmap);
+        return NULL;
+    }
+    return bitmap;
+}
+
+void destroy_sector_bitmap(SectorBitmap * bitmap) {
+    if (!bitmap) return;
+    free(bitmap->words);
+    free(bitmap);
+}
+
+void sector_bitmap_set(SectorBitmap * bitmap, int bit) {
+    bitmap->words[bit >> 6] |= (uint64_t)1 << (bit & 63);
+}
+
+void sector_bitmap_clear(SectorBitmap * bitmap, int bit) {
+    bitmap->words[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+}
+
+int sector_bitmap_test(SectorBitmap * bitmap, int bit) {
+    return (int)((bitmap->words[bit >> 6] >> (bit & 63)) & 1);
+}
+
+// number of bits set
+int sector_bitmap_count(SectorBitmap * bitmap) {
+    int count = 0;
+    for (int i = 0; i < bitmap->num_words; i++) count += __builtin_popcountll(bitmap->words[i]);
+    return count;
+}
+
+// Returns the first bit set, -1 if there is none
+int sector_bitmap_find_first_set(SectorBitmap * bitmap) {
+    for (int i = 0; i < bitmap->num_words; i++) {
+        if (bitmap->words[i]) return i * 64 + __builtin_ctzll(bitmap->words[i]);
+    }
+    return -1;
+}
+
+// Returns the first bit not set, -1 if they are all set
+int sector_bitmap_find_first_clear(SectorBitmap * bitmap) {
+    for (int i = 0; i < bitmap->num_words; i++) {
+        if (~bitmap->words[i]) {
+            int bit = i * 64 + __builtin_ctzll(~bitmap->words[i]);
+            return bit < bitmap->num_bits ? bit : -1;
+        }
+    }
+    return -1;
+}
+
+// number of bits set in both bitmaps (e.g. how many sectors of a route are occupied)
+int sector_bitmap_count_and(SectorBitmap * bitmap, SectorBitmap * mask) {
+    int n = bitmap->num_words < mask->num_words ? bitmap->num_words : mask->num_words;
+    int count = 0;
+    for (int i = 0; i < n; i++) count += __builtin_popcountll(bitmap->words[i] & mask->words[i]);
+    return count;
+}
+
+// Returns the first bit set in mask but not in bitmap (e.g. the first free sector of a route), -1 if there is none
+int sector_bitmap_find_first_clear_in(SectorBitmap * bitmap, SectorBitmap * mask) {
+    int n = bitmap->num_words < mask->num_words ? bitmap->num_words : mask->num_words;
+    for (int i = 0; i < n; i++) {
+        uint64_t candidates = mask->words[i] & ~bitmap->words[i];
+        if (candidates) return i * 64 + __builtin_ctzll(candidates);
+    }
+    return -1;
+}
+
+
 // Sector CentralizedControlMechanism functions
+static const int service_tier_weights[NUM_SERVICE_TIERS] = {8, 3, 1};
+
 CentralizedControlMechanism* create_centralized_control_mechanism(int sectors_number, int aeronaves_number) {
     CentralizedControlMechanism *ccm = malloc(sizeof(CentralizedControlMechanism));
     if (!ccm) return NULL;
@@ -373,19 +960,64 @@ CentralizedControlMechanism* create_centralized_control_mechanism(int sectors_nu
 
     // Initialize request queue with large capacity
     ccm->request_queue_size = aeronaves_number; // Large queue capacity  Lucas: isn't the max number of requests == num_aeronaves?
-    ccm->request_queue = malloc(ccm->request_queue_size * sizeof(RequestSector));
+    // each aeronave has at most one request in the lanes, but they can all be in the same tier; tier 0 also gets
+    // every release (in open mode a finished aeronave can have its release and the request of its next flight
+    // queued together) and the handoffs moved up to the tier of the first waiter: it is twice as big
+    ccm->request_queue = malloc((NUM_SERVICE_TIERS + 1) * ccm->request_queue_size * sizeof(RequestSector));
     if (!ccm->request_queue) {
         for (int i = 0; i < sectors_number; ++i) destroy_mutex_priority(ccm->mutex_sections[i]);
         free(ccm->mutex_sections);
         free(ccm);
         return NULL;
     }
-    ccm->request_queue_front = 0;
-    ccm->request_queue_rear = 0;
+    ccm->max_dwell_ms = 5;
+    ccm->verbose = 1;
+    ccm->wait_strategy = WAIT_BLOCK;
+    ccm->request_timeout_ms = 0;
+    ccm->reroute_on_timeout = 0;
+    ccm->occupied_sectors = create_sector_bitmap(sectors_number);
+    ccm->waiting_sectors = create_sector_bitmap(sectors_number);
+    ccm->wait_timers = create_timing_wheel(aeronaves_number, monotonic_ns());
+    ccm->airspace = malloc(sizeof(SectorState) * sectors_number);
+    ccm->airspace_seq = 0;
+    ccm->replication = NULL;
+    ccm->tracer = NULL;
+    if (!ccm->occupied_sectors || !ccm->waiting_sectors || !ccm->wait_timers || !ccm->airspace) {
+        for (int i = 0; i < sectors_number; ++i) destroy_mutex_priority(ccm->mutex_sections[i]);
+        destroy_sector_bitmap(ccm->occupied_sectors);
+        destroy_sector_bitmap(ccm->waiting_sectors);
+        destroy_timing_wheel(ccm->wait_timers);
+        free(ccm->airspace);
+        free(ccm->mutex_sections);
+        free(ccm->request_queue);
+        free(ccm);
+        return NULL;
+    }
+    for (int i = 0; i < sectors_number; ++i) {
+        ccm->airspace[i].busy = 0;
+        ccm->airspace[i].id_aeronave_occupying = -1;
+        ccm->airspace[i].waiting = 0;
+        ccm->airspace[i].first_waiter_tier = NUM_SERVICE_TIERS;
+    }
+    for (int t = 0; t < NUM_SERVICE_TIERS; t++) {
+        RequestLane *lane = &ccm->request_lanes[t];
+        lane->queue = ccm->request_queue + (t == 0 ? 0 : t + 1) * ccm->request_queue_size;
+        lane->capacity = (t == 0 ? 2 : 1) * ccm->request_queue_size;
+        lane->front = 0;
+        lane->rear = 0;
+        lane->count = 0;
+        lane->weight = service_tier_weights[t];
+        lane->credit = lane->weight;
+        latency_histogram_init(&ccm->grant_latency[t]);
+    }
     ccm->request_queue_count = 0;
 
     if (pthread_mutex_init(&ccm->mutex_request, NULL) != 0) {
         for (int i = 0; i < sectors_number; ++i) destroy_mutex_priority(ccm->mutex_sections[i]);
+        destroy_sector_bitmap(ccm->occupied_sectors);
+        destroy_sector_bitmap(ccm->waiting_sectors);
+        destroy_timing_wheel(ccm->wait_timers);
+        free(ccm->airspace);
         free(ccm->mutex_sections);
         free(ccm->request_queue);
         free(ccm);
@@ -410,40 +1042,80 @@ void destroy_centralized_control_mechanism(CentralizedControlMechanism * ccm) {
     }
     if(ccm->mutex_sections) free(ccm->mutex_sections);
     if(ccm->request_queue) free(ccm->request_queue);
+    destroy_sector_bitmap(ccm->occupied_sectors);
+    destroy_sector_bitmap(ccm->waiting_sectors);
+    destroy_timing_wheel(ccm->wait_timers);
+    free(ccm->airspace);
+    destroy_replication(ccm->replication);
+    destroy_tracer(ccm->tracer);
     pthread_mutex_destroy(&ccm->mutex_request);
     free(ccm);
 }
 
-// Enqueue a request to the back of the queue
+// Returns the service tier of an aeronave: 0 is served first
+int service_tier(int priority) {
+    if (priority >= SERVICE_TIER_0_MIN_PRIORITY) return 0;
+    if (priority >= SERVICE_TIER_1_MIN_PRIORITY) return 1;
+    return 2;
+}
+
+// Enqueue a request to the back of the lane of its tier
 int enqueue_request(CentralizedControlMechanism * ccm, RequestSector * request) {
     if (!ccm || !request) return -1;
+    int tier = request->tier;
+    if (tier < 0 || tier >= NUM_SERVICE_TIERS) return -1;
+    RequestLane *lane = &ccm->request_lanes[tier];
     
     pthread_mutex_lock(&ccm->mutex_request);
     
     // Check if queue is full
-    if (ccm->request_queue_count >= ccm->request_queue_size) {
+    if (lane->count >= lane->capacity) {
         printf("\033[33m[ENQUEUE] Error: Request queue is full. Cannot enqueue request.\033[0m\n");
         pthread_mutex_unlock(&ccm->mutex_request);
         return -1;
     }
     
     // Add request to the rear of the queue
-    ccm->request_queue[ccm->request_queue_rear] = *request;
-    ccm->request_queue_rear = (ccm->request_queue_rear + 1) % ccm->request_queue_size;
+    lane->queue[lane->rear] = *request;
+    lane->rear = (lane->rear + 1) % lane->capacity;
+    lane->count++;
     ccm->request_queue_count++;
+    TRACE(ccm, TRACE_ENQUEUE, request->id_aeronave, request->id_sector, request->request_type);
     if(request->request_type == 0){
-        printf("\033[33m[ENQUEUE] Request queued. Aircraft %d wants to enter Sector %d. Queue size: %d\033[0m\n",
+        LOG(ccm, "\033[33m[ENQUEUE] Request queued. Aircraft %d wants to enter Sector %d. Queue size: %d\033[0m\n",
                request->id_aeronave, request->id_sector, ccm->request_queue_count);
     }
+    else if(request->request_type == 2){
+        LOG(ccm, "\033[33m[ENQUEUE] Request queued. Aircraft %d wants to move from Sector %d to Sector %d. Queue size: %d\033[0m\n",
+               request->id_aeronave, request->id_sector_from, request->id_sector, ccm->request_queue_count);
+    }
     else{
-        printf("\033[33m[ENQUEUE] Request queued. Aircraft %d wants to leave Sector %d. Queue size: %d\033[0m\n",
+        LOG(ccm, "\033[33m[ENQUEUE] Request queued. Aircraft %d wants to leave Sector %d. Queue size: %d\033[0m\n",
                request->id_aeronave, request->id_sector, ccm->request_queue_count);
     }
     pthread_mutex_unlock(&ccm->mutex_request);
     return 0;
 }
 
-// Dequeue a request from the front of the queue
+// weighted round: the first lane (highest tier) with requests and credit is served; when no lane with requests has
+// credit left, every lane gets its weight back
+static RequestLane* next_request_lane(CentralizedControlMechanism * ccm) {
+    for (int round = 0; round < 2; round++) {
+        for (int t = 0; t < NUM_SERVICE_TIERS; t++) {
+            RequestLane *lane = &ccm->request_lanes[t];
+            if (lane->count > 0 && lane->credit > 0) {
+                lane->credit--;
+                return lane;
+            }
+        }
+        for (int t = 0; t < NUM_SERVICE_TIERS; t++) {
+            ccm->request_lanes[t].credit = ccm->request_lanes[t].weight;
+        }
+    }
+    return NULL;
+}
+
+// Dequeue a request from the front of the lane chosen by the weighted priority
 RequestSector* dequeue_request(CentralizedControlMechanism * ccm) {
     if (!ccm) return NULL;
     
@@ -456,15 +1128,21 @@ RequestSector* dequeue_request(CentralizedControlMechanism * ccm) {
     }
     
     // Get request from front of queue
-    RequestSector * request = &ccm->request_queue[ccm->request_queue_front];
-    ccm->request_queue_front = (ccm->request_queue_front + 1) % ccm->request_queue_size;
+    RequestLane *lane = next_request_lane(ccm);
+    RequestSector * request = &lane->queue[lane->front];
+    lane->front = (lane->front + 1) % lane->capacity;
+    lane->count--;
     ccm->request_queue_count--;
+    TRACE(ccm, TRACE_DEQUEUE, request->id_aeronave, request->id_sector, request->request_type);
     
     if(request->request_type == 0){
-        printf("\033[33m[DEQUEUE] Request dequeued. Aircraft %d wants to enter Sector %d. Remaining: %d\033[0m\n", request->id_aeronave, request->id_sector, ccm->request_queue_count);
+        LOG(ccm, "\033[33m[DEQUEUE] Request dequeued. Aircraft %d wants to enter Sector %d. Remaining: %d\033[0m\n", request->id_aeronave, request->id_sector, ccm->request_queue_count);
+    }
+    else if(request->request_type == 2){
+        LOG(ccm, "\033[33m[DEQUEUE] Request dequeued. Aircraft %d wants to move from Sector %d to Sector %d. Remaining: %d\033[0m\n", request->id_aeronave, request->id_sector_from, request->id_sector, ccm->request_queue_count);
     }
     else{
-        printf("\033[33m[DEQUEUE] Request dequeued. Aircraft %d wants to leave Sector %d. Remaining: %d\033[0m\n", request->id_aeronave, request->id_sector, ccm->request_queue_count);
+        LOG(ccm, "\033[33m[DEQUEUE] Request dequeued. Aircraft %d wants to leave Sector %d. Remaining: %d\033[0m\n", request->id_aeronave, request->id_sector, ccm->request_queue_count);
     }
     pthread_mutex_unlock(&ccm->mutex_request);
     return request;
@@ -476,50 +1154,240 @@ int is_request_queue_empty(CentralizedControlMechanism * ccm) {
 }
 
 
-Sector* control_priority(RequestSector* request, MutexPriority ** mutex_priorities, 
-                         pthread_mutex_t * mutex_request) {
-    (void)mutex_request; // Mark as intentionally unused
+// number of busy sectors, read from the occupancy bitmap (only exact inside the CCM thread)
+int count_occupied_sectors(CentralizedControlMechanism * ccm) {
+    return sector_bitmap_count(ccm->occupied_sectors);
+}
+
+// number of sectors with aeronaves in their waiting list (only exact inside the CCM thread)
+int count_waiting_sectors(CentralizedControlMechanism * ccm) {
+    return sector_bitmap_count(ccm->waiting_sectors);
+}
+
+// Returns the number of sectors whose bits in occupied_sectors / waiting_sectors don't match the sector and its
+// waiting list (0 if the bitmaps are in sync; call it from the CCM thread or once the CCM has stopped)
+int check_sector_bitmaps(Simulation * sim) {
+    int wrong = 0;
+    for (int i = 0; i < sim->number_sectors; i++) {
+        int busy = sim->sectors[i]->busy != 0;
+        int waiting = !is_empty_mutex_priority(sim->ccm->mutex_sections[i]);
+        if (sector_bitmap_test(sim->ccm->occupied_sectors, i) != busy || sector_bitmap_test(sim->ccm->waiting_sectors, i) != waiting) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+// wakes an aeronave that got its sector, and records how long it waited since its request
+static void grant_aeronave(Simulation * sim, Aeronave * aeronave, int id_sector) {
+    TRACE(sim->ccm, TRACE_GRANT, aeronave->id, id_sector, 0);
+    latency_histogram_record(&sim->ccm->grant_latency[service_tier(aeronave->priority)], monotonic_ns() - aeronave->request_ns);
+    sem_post(&sim->ccm->semaphores_aeronaves[aeronave->id]);
+}
+
+// Seqlock of the airspace copy: the CCM is the only writer, so it never waits; a monitor copies the sectors and
+// starts again if the sequence number was odd (write in progress) or changed while it was copying.
+// The fields are read and written with relaxed atomics, the fences order them with the sequence number.
+static void publish_sectors(Simulation * sim, int id_sector, int id_sector_from) {
+    CentralizedControlMechanism *ccm = sim->ccm;
+    uint64_t seq = __atomic_load_n(&ccm->airspace_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&ccm->airspace_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int k = 0; k < 2; k++) {
+        int id = k == 0 ? id_sector : id_sector_from;
+        if (id < 0 || id >= ccm->num_mutex_sections) continue;
+        SectorState *state = &ccm->airspace[id];
+        __atomic_store_n(&state->busy, sim->sectors[id]->busy, __ATOMIC_RELAXED);
+        __atomic_store_n(&state->id_aeronave_occupying, sim->sectors[id]->id_aeronave_occupying, __ATOMIC_RELAXED);
+        __atomic_store_n(&state->waiting, ccm->mutex_sections[id]->waiting_list_size, __ATOMIC_RELAXED);
+        MutexPriority *mp = ccm->mutex_sections[id];
+        int tier = mp->waiting_list_size > 0 ? service_tier(mp->waiting_list[0]->priority) : NUM_SERVICE_TIERS;
+        __atomic_store_n(&state->first_waiter_tier, tier, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ccm->airspace_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+AirspaceSnapshot* create_airspace_snapshot(Simulation * sim) {
+    AirspaceSnapshot *snapshot = malloc(sizeof(AirspaceSnapshot));
+    if (!snapshot) return NULL;
+    snapshot->sectors = malloc(sizeof(SectorState) * sim->number_sectors);
+    if (!snapshot->sectors) {
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->number_sectors = sim->number_sectors;
+    snapshot->version = 0;
+    snapshot->occupied = 0;
+    snapshot->waiting = 0;
+    return snapshot;
+}
+
+void destroy_airspace_snapshot(AirspaceSnapshot * snapshot) {
+    if (!snapshot) return;
+    free(snapshot->sectors);
+    free(snapshot);
+}
+
+// Copies a consistent view of every sector into snapshot, without taking any lock
+// Returns the number of retries (copies thrown away because the CCM wrote during them)
+int snapshot_airspace(Simulation * sim, AirspaceSnapshot * snapshot) {
+    CentralizedControlMechanism *ccm = sim->ccm;
+    int retries = 0;
+    while (1) {
+        uint64_t before = __atomic_load_n(&ccm->airspace_seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            retries++;
+            cpu_relax();
+            continue;
+        }
+        int occupied = 0, waiting = 0;
+        for (int i = 0; i < snapshot->number_sectors; i++) {
+            SectorState *state = &snapshot->sectors[i];
+            state->busy = __atomic_load_n(&ccm->airspace[i].busy, __ATOMIC_RELAXED);
+            state->id_aeronave_occupying = __atomic_load_n(&ccm->airspace[i].id_aeronave_occupying, __ATOMIC_RELAXED);
+            state->waiting = __atomic_load_n(&ccm->airspace[i].waiting, __ATOMIC_RELAXED);
+            state->first_waiter_tier = __atomic_load_n(&ccm->airspace[i].first_waiter_tier, __ATOMIC_RELAXED);
+            occupied += state->busy;
+            waiting += state->waiting;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ccm->airspace_seq, __ATOMIC_RELAXED) == before) {
+            snapshot->version = before;
+            snapshot->occupied = occupied;
+            snapshot->waiting = waiting;
+            return retries;
+        }
+        retries++;
+    }
+}
+
+// Appends a change of the CCM state to the replication log (CCM thread only)
+// If the standby is behind by a whole log, the CCM waits for it: the copy of the standby must never miss an event
+static void replicate(Simulation * sim, int type, int id_sector, int id_aeronave, int position, uint64_t deadline_ns) {
+    Replication *r = sim->ccm->replication;
+    if (!r || r->failovers) return; // after a failover there is no standby anymore
+    uint64_t head = r->head;
+    while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= REPLICATION_LOG_SIZE) {
+        r->log_full_waits++;
+        sched_yield();
+    }
+    ReplicationEvent *e = &r->events[head & (REPLICATION_LOG_SIZE - 1)];
+    e->type = type;
+    e->id_sector = id_sector;
+    e->id_aeronave = id_aeronave;
+    e->position = position;
+    e->deadline_ns = deadline_ns;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    r->events_total++;
+}
+
+// called by the timing wheel for each aeronave whose request reached its deadline
+static void expire_wait_timeout(TimerNode * timer, void * arg) {
+    Simulation *sim = (Simulation *)arg;
+    MutexPriority *mp = sim->ccm->mutex_sections[timer->id_sector];
+    Aeronave *a = remove_aeronave_by_id_mutex_priority(mp, timer->id_aeronave);
+    if (a == NULL) return; // already granted
+    TRACE(sim->ccm, TRACE_WAITLIST_REMOVE, a->id, timer->id_sector, 1);
+    replicate(sim, REPL_UNWAIT, timer->id_sector, a->id, 0, 0);
+    if (is_empty_mutex_priority(mp)) {
+        sector_bitmap_clear(sim->ccm->waiting_sectors, timer->id_sector);
+    }
+    LOG(sim->ccm, "\033[31m[CONTROL_PRIORITY] Request of aircraft %d for sector %d timed out.\033[0m\n", a->id, timer->id_sector);
+    a->wait_result = WAIT_TIMED_OUT;
+    sem_post(&sim->ccm->semaphores_aeronaves[a->id]);
+    publish_sectors(sim, timer->id_sector, -1);
+}
+
+// Wakes the aeronaves whose request deadline has passed (CCM thread only)
+// Returns the number of requests that timed out
+int expire_wait_timeouts(Simulation * sim) {
+    return timing_wheel_advance(sim->ccm->wait_timers, monotonic_ns(), expire_wait_timeout, sim);
+}
+
+// Frees a sector inside the CCM thread: the first aeronave of the waiting list gets it, otherwise it becomes available
+// (used by release requests and by handoffs, so the CCM never has to send a request to its own queue)
+static Sector* control_release(Simulation * sim, int id_sector, int id_aeronave) {
+    Aeronave *released = remove_aeronave_mutex_priority(sim->ccm->mutex_sections[id_sector]);
+    if (is_empty_mutex_priority(sim->ccm->mutex_sections[id_sector])) {
+        sector_bitmap_clear(sim->ccm->waiting_sectors, id_sector);
+    }
+    if(released != NULL){
+        TRACE(sim->ccm, TRACE_WAITLIST_REMOVE, released->id, id_sector, 0);
+        timing_wheel_cancel(sim->ccm->wait_timers, released->id);
+        replicate(sim, REPL_UNWAIT, id_sector, released->id, 0, 0);
+        replicate(sim, REPL_OCCUPY, id_sector, released->id, 0, 0);
+        LOG(sim->ccm, "\033[31m[CONTROL_PRIORITY] Aircraft %d released sector %d. Aircraft %d is now free to go.\033[0m\n", id_aeronave, id_sector, released->id);
+        sim->sectors[id_sector]->id_aeronave_occupying = released->id;
+        grant_aeronave(sim, released, id_sector);
+    }
+    else{
+        LOG(sim->ccm, "\033[31m[CONTROL_PRIORITY] Aircraft %d released sector %d.\033[0m\n", id_aeronave, id_sector);
+        sim->sectors[id_sector]->busy = 0;
+        sim->sectors[id_sector]->id_aeronave_occupying = -1;
+        sector_bitmap_clear(sim->ccm->occupied_sectors, id_sector);
+        replicate(sim, REPL_FREE, id_sector, id_aeronave, 0, 0);
+    }
+    LOG(sim->ccm, "\033[34m[AIRCRAFT %d] Left sector %d\033[0m\n", id_aeronave, id_sector);
+    return sim->sectors[id_sector];
+}
 
+// processes one request; control_priority() then publishes the sectors it changed
+static Sector* control_request(Simulation * sim, RequestSector* request) {
     if (request == NULL) {
         printf("\033[31m[CONTROL_PRIORITY] Error: request pointer is NULL. Exiting function.\033[0m\n");
         return NULL;
     }
 
-    int is_busy = sectors[request->id_sector]->busy;
+    int is_busy = sector_bitmap_test(sim->ccm->occupied_sectors, request->id_sector);
 
-    if(request->request_type == 0){ // if it's to ask for entrance
+    if(request->request_type == 0 || request->request_type == 2){ // if it's to ask for entrance (handoffs also leave id_sector_from)
         if (is_busy == 0) {
             // Sector is FREE: mutex acquired successfully (probe only)
-            printf("\033[31m[CONTROL_PRIORITY] Aircraft %d acquired sector %d (lock successful).\033[0m\n",
+            LOG(sim->ccm, "\033[31m[CONTROL_PRIORITY] Aircraft %d acquired sector %d (lock successful).\033[0m\n",
                 request->id_aeronave, request->id_sector);
             
             // there parameters are changed to tell the sector is busy
-            sectors[request->id_sector]->busy = 1;
-            sectors[request->id_sector]->id_aeronave_occupying = request->id_aeronave;
+            sim->sectors[request->id_sector]->busy = 1;
+            sim->sectors[request->id_sector]->id_aeronave_occupying = request->id_aeronave;
+            sector_bitmap_set(sim->ccm->occupied_sectors, request->id_sector);
+            replicate(sim, REPL_OCCUPY, request->id_sector, request->id_aeronave, 0, 0);
             
             // Wake the aircraft; it will perform the actual acquire_sector() trylock
-            sem_post(&centralized_control_mechanism->semaphores_aeronaves[request->id_aeronave]);
+            grant_aeronave(sim, sim->aeronaves[request->id_aeronave], request->id_sector);
+
+            // the sector being left is handed to its next aeronave right now; the aircraft only unlocks
+            // it after acquiring the new one, so whoever gets it keeps retrying acquire_sector() until then
+            if (request->request_type == 2) {
+                control_release(sim, request->id_sector_from, request->id_aeronave);
+            }
 
             // Informative pointer returned
-            return sectors[request->id_sector];
+            return sim->sectors[request->id_sector];
         } 
         else if (is_busy == 1) {
-            printf("[CONTROL_PRIORITY] Sector %d is occupied by aircraft %d. Adding aircraft %d to waiting list.\n", 
-                request->id_sector, sectors[request->id_sector]->id_aeronave_occupying, request->id_aeronave);
+            LOG(sim->ccm, "[CONTROL_PRIORITY] Sector %d is occupied by aircraft %d. Adding aircraft %d to waiting list.\n", 
+                request->id_sector, sim->sectors[request->id_sector]->id_aeronave_occupying, request->id_aeronave);
             
             // if the current aeronave already has a sector release his current sector
             // avoird poss and waiting in two sectors at the same time
-            if (aeronaves[request->id_aeronave]->current_sector != NULL) {
-                release_sector(
-                    aeronaves[request->id_aeronave], 
-                    aeronaves[request->id_aeronave]->current_sector
-                );
+            // the release is processed inline instead of going back through the request queue
+            if (request->request_type == 2) {
+                // a semaphore and not a mutex: the CCM can post it for the aeronave that took it
+                // (through unlock_sector(), so the release is traced like the ones done by the aeronaves)
+                unlock_sector(sim, sim->aeronaves[request->id_aeronave], sim->sectors[request->id_sector_from]);
+                control_release(sim, request->id_sector_from, request->id_aeronave);
             }
-            insert_aeronave_mutex_priority(
-                mutex_priorities[request->id_sector], aeronaves[request->id_aeronave]
+            int position = insert_aeronave_mutex_priority(
+                sim->ccm->mutex_sections[request->id_sector], sim->aeronaves[request->id_aeronave]
             );
+            sector_bitmap_set(sim->ccm->waiting_sectors, request->id_sector);
+            TRACE(sim->ccm, TRACE_WAITLIST_INSERT, request->id_aeronave, request->id_sector, 0);
+            replicate(sim, REPL_WAIT, request->id_sector, request->id_aeronave, position, request->deadline_ns);
+            if (request->deadline_ns != 0) {
+                timing_wheel_add(sim->ccm->wait_timers, request->id_aeronave, request->id_sector, request->deadline_ns);
+            }
 
-            printf("\033[31m[CONTROL_PRIORITY] Aircraft %d added to waiting list for sector %d.\033[0m\n", 
+            LOG(sim->ccm, "\033[31m[CONTROL_PRIORITY] Aircraft %d added to waiting list for sector %d.\033[0m\n", 
                 request->id_aeronave, request->id_sector);
 
             return NULL;
@@ -530,19 +1398,339 @@ Sector* control_priority(RequestSector* request, MutexPriority ** mutex_prioriti
         }
     }
     else{ // if the request is a flag from the aeronave that has just released the sector, it dequeues it from that sector and wakes the waiting aeronave
-        int id_sector = request->id_sector;
-        Aeronave *released = remove_aeronave_mutex_priority(mutex_priorities[id_sector]);
-        if(released != NULL){
-            printf("\033[31m[CONTROL_PRIORITY] Aircraft %d released sector %d. Aircraft %d is now free to go.\033[0m\n", request->id_aeronave, id_sector, released->id);
-            sem_post(&centralized_control_mechanism->semaphores_aeronaves[released->id]);
-            sectors[request->id_sector]->id_aeronave_occupying = released->id;
+        return control_release(sim, request->id_sector, request->id_aeronave);
+    }
+}
+
+Sector* control_priority(Simulation * sim, RequestSector* request) {
+    Sector *sector = control_request(sim, request);
+    if (request != NULL) publish_sectors(sim, request->id_sector, request->request_type == 2 ? request->id_sector_from : -1);
+    return sector;
+}
+
+// Replication functions
+// The standby starts from a copy of the current state, so it has to be created before the CCM thread starts
+Replication* create_replication(Simulation * sim, int heartbeat_timeout_ms) {
+    Replication *r = calloc(1, sizeof(Replication));
+    if (!r) return NULL;
+    r->num_sectors = sim->number_sectors;
+    r->num_aeronaves = sim->number_aeronaves;
+    r->events = malloc(sizeof(ReplicationEvent) * REPLICATION_LOG_SIZE);
+    r->mutex_sections = calloc(r->num_sectors, sizeof(MutexPriority*));
+    r->occupant = malloc(sizeof(int) * r->num_sectors);
+    r->deadline_ns = calloc(r->num_aeronaves, sizeof(uint64_t));
+    if (!r->events || !r->mutex_sections || !r->occupant || !r->deadline_ns) {
+        destroy_replication(r);
+        return NULL;
+    }
+    for (int i = 0; i < r->num_sectors; i++) {
+        r->mutex_sections[i] = create_mutex_priority(r->num_aeronaves, i);
+        MutexPriority *mp = sim->ccm->mutex_sections[i];
+        for (int j = 0; j < mp->waiting_list_size; j++) r->mutex_sections[i]->waiting_list[j] = mp->waiting_list[j];
+        r->mutex_sections[i]->waiting_list_size = mp->waiting_list_size;
+        r->occupant[i] = sim->sectors[i]->busy ? sim->sectors[i]->id_aeronave_occupying : -1;
+    }
+    r->heartbeat_timeout_ms = heartbeat_timeout_ms;
+    sim->ccm->replication = r;
+    return r;
+}
+
+void destroy_replication(Replication * r) {
+    if (!r) return;
+    if (r->mutex_sections) {
+        for (int i = 0; i < r->num_sectors; i++) destroy_mutex_priority(r->mutex_sections[i]);
+        free(r->mutex_sections);
+    }
+    free(r->events);
+    free(r->occupant);
+    free(r->deadline_ns);
+    free(r);
+}
+
+static void apply_replication_event(Simulation * sim, Replication * r, ReplicationEvent * e) {
+    switch (e->type) {
+        case REPL_OCCUPY:
+            r->occupant[e->id_sector] = e->id_aeronave;
+            break;
+        case REPL_FREE:
+            r->occupant[e->id_sector] = -1;
+            break;
+        case REPL_WAIT: // same inserts (at the same positions) and removals in the same order: the waiting lists end up identical
+            // (not by priority: the standby lags, a reused aeronave may already have the priority of its next flight)
+            insert_aeronave_at_mutex_priority(r->mutex_sections[e->id_sector], sim->aeronaves[e->id_aeronave], e->position);
+            r->deadline_ns[e->id_aeronave] = e->deadline_ns;
+            break;
+        case REPL_UNWAIT:
+            remove_aeronave_by_id_mutex_priority(r->mutex_sections[e->id_sector], e->id_aeronave);
+            break;
+    }
+}
+
+// applies every event the primary has written, returns how many there were
+static uint64_t apply_replication_log(Simulation * sim, Replication * r) {
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->tail;
+    uint64_t applied = head - tail;
+    for (; tail < head; tail++) {
+        apply_replication_event(sim, r, &r->events[tail & (REPLICATION_LOG_SIZE - 1)]);
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    return applied;
+}
+
+// The standby becomes the CCM: fences the old primary off, waits for the request it may be processing, then
+// installs its copy of the sectors and waiting lists (the mutexes of the sectors stay, the aeronaves hold them)
+// and arms again the deadlines of the waiting aeronaves. The request queue is shared, nothing to do there.
+static void take_over(Simulation * sim, Replication * r, uint64_t last_heartbeat_ns) {
+    CentralizedControlMechanism *ccm = sim->ccm;
+    uint64_t start = monotonic_ns();
+    __atomic_add_fetch(&r->epoch, 1, __ATOMIC_SEQ_CST);
+    r->replayed_at_takeover = apply_replication_log(sim, r);
+    while (__atomic_load_n(&r->in_request, __ATOMIC_SEQ_CST)) { // a slow primary, not a dead one
+        r->replayed_at_takeover += apply_replication_log(sim, r);
+        sched_yield();
+    }
+    r->replayed_at_takeover += apply_replication_log(sim, r);
+
+    for (int i = 0; i < r->num_aeronaves; i++) timing_wheel_cancel(ccm->wait_timers, i);
+    for (int i = 0; i < r->num_sectors; i++) {
+        MutexPriority *mp = ccm->mutex_sections[i], *copy = r->mutex_sections[i];
+        memcpy(mp->waiting_list, copy->waiting_list, sizeof(Aeronave*) * copy->waiting_list_size);
+        mp->waiting_list_size = copy->waiting_list_size;
+        for (int j = 0; j < mp->waiting_list_size; j++) {
+            int id = mp->waiting_list[j]->id;
+            if (r->deadline_ns[id] != 0) timing_wheel_add(ccm->wait_timers, id, i, r->deadline_ns[id]);
         }
-        else{
-            printf("\033[31m[CONTROL_PRIORITY] Aircraft %d released sector %d.\033[0m\n", request->id_aeronave, id_sector);
-            sectors[request->id_sector]->busy = 0;
-            sectors[request->id_sector]->id_aeronave_occupying = -1;
+        if (mp->waiting_list_size > 0) sector_bitmap_set(ccm->waiting_sectors, i);
+        else sector_bitmap_clear(ccm->waiting_sectors, i);
+
+        sim->sectors[i]->busy = r->occupant[i] >= 0;
+        sim->sectors[i]->id_aeronave_occupying = r->occupant[i];
+        if (r->occupant[i] >= 0) sector_bitmap_set(ccm->occupied_sectors, i);
+        else sector_bitmap_clear(ccm->occupied_sectors, i);
+        publish_sectors(sim, i, -1);
+    }
+    uint64_t end = monotonic_ns();
+    r->failovers++;
+    r->failover_takeover_ns = end - start;
+    r->failover_silence_ns = end - last_heartbeat_ns;
+}
+
+// Standby thread: keeps its copy up to date until the primary misses its heartbeats, then runs the CCM loop
+void run_standby_ccm(Simulation * sim) {
+    Replication *r = sim->ccm->replication;
+    if (!r) return;
+    LOG(sim->ccm, "\033[32m[STANDBY] Standby CCM thread started\033[0m\n");
+    uint64_t timeout_ns = (uint64_t)r->heartbeat_timeout_ms * 1000000ull;
+    while (1) {
+        apply_replication_log(sim, r);
+        uint64_t heartbeat = __atomic_load_n(&r->heartbeat_ns, __ATOMIC_ACQUIRE);
+        // after stop the standby still watches a primary that hasn't finished: if it died, the requests left in
+        // the lanes are only processed by the takeover (0: no primary ever ran)
+        if (sim->stop && (heartbeat == 0 || __atomic_load_n(&r->primary_done, __ATOMIC_ACQUIRE))) break;
+        if (heartbeat != 0 && monotonic_ns() - heartbeat > timeout_ns) { // 0: the primary hasn't started yet
+            LOG(sim->ccm, "\033[32m[STANDBY] No heartbeat from the CCM for %d ms, taking over\033[0m\n", r->heartbeat_timeout_ms);
+            take_over(sim, r, heartbeat);
+            run_centralized_control(sim);
+            return;
+        }
+        usleep(100);
+    }
+    LOG(sim->ccm, "\033[32m[STANDBY] Standby CCM thread finished\033[0m\n");
+}
+
+// Tracer functions
+static const char *trace_event_names[NUM_TRACE_EVENTS] = {
+    "enqueue", "dequeue", "grant", "waitlist_insert", "waitlist_remove", "wake", "acquire", "release"
+};
+
+const char* trace_event_name(int type) {
+    return type >= 0 && type < NUM_TRACE_EVENTS ? trace_event_names[type] : "unknown";
+}
+
+// Returns the TraceEventType called name, -1 if there is none
+int parse_trace_event(const char * name) {
+    for (int i = 0; i < NUM_TRACE_EVENTS; i++) {
+        if (strcmp(name, trace_event_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+Tracer* create_tracer(long capacity) {
+    Tracer *tracer = malloc(sizeof(Tracer));
+    if (!tracer) return NULL;
+    tracer->events = malloc(sizeof(TraceEvent) * capacity);
+    if (!tracer->events) {
+        free(tracer);
+        return NULL;
+    }
+    tracer->capacity = capacity;
+    tracer->next = 0;
+    return tracer;
+}
+
+void destroy_tracer(Tracer * tracer) {
+    if (!tracer) return;
+    free(tracer->events);
+    free(tracer);
+}
+
+// called by TRACE() from any thread: the slot is reserved with an atomic increment, events past capacity are dropped
+void trace_event(Tracer * tracer, int type, int id_aeronave, int id_sector, int detail) {
+    long i = __atomic_fetch_add(&tracer->next, 1, __ATOMIC_RELAXED);
+    if (i >= tracer->capacity) return;
+    TraceEvent *e = &tracer->events[i];
+    e->ts_ns = monotonic_ns();
+    e->type = type;
+    e->id_aeronave = id_aeronave;
+    e->id_sector = id_sector;
+    e->detail = detail;
+}
+
+// Writes the events as csv (ts_ns,event,aeronave,sector,detail), once every thread that traces has finished
+// Returns the number of events written, -1 if the file can't be written
+long write_trace(Tracer * tracer, const char * path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    long n = tracer->next < tracer->capacity ? tracer->next : tracer->capacity;
+    fprintf(f, "ts_ns,event,aeronave,sector,detail\n");
+    for (long i = 0; i < n; i++) {
+        TraceEvent *e = &tracer->events[i];
+        fprintf(f, "%llu,%s,%d,%d,%d\n", (unsigned long long)e->ts_ns, trace_event_name(e->type),
+                e->id_aeronave, e->id_sector, e->detail);
+    }
+    fclose(f);
+    return n;
+}
+
+// Simulation functions
+// Everything a simulation needs (sectors, aeronaves and its CCM) lives in the handle, so several simulations can run
+// in the same process. The aeronaves array starts empty: the caller creates them with create_aeronave().
+Simulation* create_simulation(int number_sectors, int number_aeronaves, unsigned int seed) {
+    Simulation *sim = malloc(sizeof(Simulation));
+    if (!sim) return NULL;
+    sim->number_sectors = number_sectors;
+    sim->number_aeronaves = number_aeronaves;
+    sim->seed = seed;
+    sim->procedural_routes = 0;
+    sim->stop = 0;
+    sim->sectors = malloc(sizeof(Sector*) * number_sectors);
+    sim->aeronaves = calloc(number_aeronaves, sizeof(Aeronave*));
+    sim->ccm = create_centralized_control_mechanism(number_sectors, number_aeronaves);
+    if (!sim->sectors || !sim->aeronaves || !sim->ccm) {
+        free(sim->sectors);
+        free(sim->aeronaves);
+        destroy_centralized_control_mechanism(sim->ccm);
+        free(sim);
+        return NULL;
+    }
+    for (int i = 0; i < number_sectors; i++) {
+        sim->sectors[i] = create_sector(i);
+    }
+    return sim;
+}
+
+void destroy_simulation(Simulation * sim) {
+    if (!sim) return;
+    for (int i = 0; i < sim->number_sectors; i++) destroy_sector(sim->sectors[i]);
+    for (int i = 0; i < sim->number_aeronaves; i++) destroy_aeronave(sim->aeronaves[i]);
+    free(sim->sectors);
+    free(sim->aeronaves);
+    destroy_centralized_control_mechanism(sim->ccm);
+    free(sim);
+}
+
+// Main loop of the CCM thread: continuously process requests from the queue until sim->stop is set
+// With a standby, it also sends heartbeats and stops as soon as the standby has taken over (fencing by epoch)
+// one turn of the CCM loop: heartbeat, timeouts and at most one request
+// Returns 1 if a request was processed, 0 if the lanes were empty, -1 if this CCM must stop now
+// (the standby took over, or the fault injection killed it)
+static int centralized_control_step(Simulation * sim, int epoch) {
+    Replication *r = sim->ccm->replication;
+    if (r) {
+        __atomic_store_n(&r->heartbeat_ns, monotonic_ns(), __ATOMIC_RELEASE);
+        __atomic_store_n(&r->in_request, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST) != epoch) {
+            __atomic_store_n(&r->in_request, 0, __ATOMIC_SEQ_CST);
+            LOG(sim->ccm, "\033[32m[CCM_THREAD] The standby took over, this CCM stops\033[0m\n");
+            return -1;
+        }
+    }
+    expire_wait_timeouts(sim);
+
+    // Dequeue a request from the front of the queue (FIFO)
+    RequestSector * current_request = dequeue_request(sim->ccm);
+    
+    // Check if there is a valid request
+    if (current_request != NULL) {
+        LOG(sim->ccm, "\033[32m[CCM_THREAD] Processing request: Aircraft %d for Sector %d\033[0m\n", 
+            current_request->id_aeronave,
+            current_request->id_sector);
+        control_priority(sim, current_request);
+    } 
+    if (r) {
+        __atomic_store_n(&r->in_request, 0, __ATOMIC_RELEASE);
+        if (current_request != NULL && epoch == 0 && ++r->requests == r->kill_after_requests) {
+            LOG(sim->ccm, "\033[32m[CCM_THREAD] Fault injection: the CCM dies after %ld requests\033[0m\n", r->requests);
+            return -1;
+        }
+    }
+    return current_request != NULL;
+}
+
+static void centralized_control_done(Simulation * sim) {
+    Replication *r = sim->ccm->replication;
+    if (r) __atomic_store_n(&r->primary_done, 1, __ATOMIC_RELEASE);
+    LOG(sim->ccm, "\033[32m[CCM_THREAD] Centralized Control Mechanism thread finished\033[0m\n");
+}
+
+void run_centralized_control(Simulation * sim) {
+    Replication *r = sim->ccm->replication;
+    int epoch = r ? __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST) : 0;
+    LOG(sim->ccm, "\033[32m[CCM_THREAD] Centralized Control Mechanism thread started\033[0m\n");
+    while (1) {
+        // read before the dequeue: once stop is set no aeronave sends requests, so the loop only ends when the
+        // lanes are empty (the last releases are still processed)
+        int stopping = sim->stop;
+        int served = centralized_control_step(sim, epoch);
+        if (served < 0) return;
+        if (served == 0) {
+            if (stopping) break;
+            usleep(100);
+        }
+    }
+    centralized_control_done(sim);
+}
+
+// One thread serving the CCMs of several simulations in turn, so a process running many simulations doesn't need a
+// CCM thread for each one (a pool is a few threads, each with its share of the simulations).
+// Each simulation keeps its own lanes, waiting lists and timers: the thread only lends them its time.
+// Returns when every simulation has stopped (same rule as run_centralized_control())
+void run_shared_centralized_control(Simulation ** sims, int num_sims) {
+    int *epochs = malloc(sizeof(int) * (num_sims > 0 ? num_sims : 1));
+    int *running = malloc(sizeof(int) * (num_sims > 0 ? num_sims : 1));
+    for (int i = 0; i < num_sims; i++) {
+        Replication *r = sims[i]->ccm->replication;
+        epochs[i] = r ? __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST) : 0;
+        running[i] = 1;
+        LOG(sims[i]->ccm, "\033[32m[CCM_THREAD] Centralized Control Mechanism thread started (shared by %d simulations)\033[0m\n", num_sims);
+    }
+    int left = num_sims;
+    while (left > 0) {
+        int served = 0;
+        for (int i = 0; i < num_sims; i++) {
+            if (!running[i]) continue;
+            int stopping = sims[i]->stop;
+            int step = centralized_control_step(sims[i], epochs[i]);
+            if (step > 0) served++;
+            else if (step < 0 || stopping) {
+                if (step == 0) centralized_control_done(sims[i]);
+                running[i] = 0;
+                left--;
+            }
         }
-        printf("\033[34m[AIRCRAFT %d] Left sector %d\033[0m\n", request->id_aeronave, id_sector);
-        return sectors[id_sector];
+        if (served == 0 && left > 0) usleep(100);
     }
+    free(epochs);
+    free(running);
 }
@@ -5,6 +5,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include <semaphore.h>
+#include <stdint.h>
 
 typedef struct{
     int id;
@@ -12,50 +13,266 @@ typedef struct{
     int id_aeronave_occupying;
 }Sector; 
 
+// how an aeronave waits for the authorization of the CCM in wait_sector()
+typedef enum{
+    WAIT_BLOCK = 0,     // sem_wait only (default)
+    WAIT_SPIN_PARK = 1, // spins on the semaphore for an adaptive budget, then sem_wait
+    WAIT_BUSY_POLL = 2  // spins until authorized, for aeronaves running on dedicated cores
+}WaitStrategy;
+
+// wait_sector() results
+#define WAIT_GRANTED 0
+#define WAIT_TIMED_OUT 1
+
+#define SPIN_BUDGET_INITIAL_NS 10000 // 10us
+#define SPIN_BUDGET_MIN_NS 1000
+#define SPIN_BUDGET_MAX_NS 100000
+
 typedef struct{
     int id;
     int priority;
-    int * rota;
+    int * rota;        // explicit route, NULL if the route is procedural
     int tam_rota;
+    int rota_capacity; // size of the rota array, so a finished aeronave can be reused with another route
     int current_index_rota;
+    unsigned int route_seed; // procedural route: every hop is generated from this seed, so the route needs no array
+    int route_hop;           // procedural route: sector at index route_hop_index (generated when the route advances)
+    int route_hop_index;
     Sector * current_sector;
     int aguardar;
+    unsigned int rand_state; // rand_r() state of the aeronave thread (dwell times)
+    uint64_t spin_budget_ns; // WAIT_SPIN_PARK: how long wait_sector() spins before blocking
+    uint64_t avg_wait_ns;    // WAIT_SPIN_PARK: moving average of the waits, sets spin_budget_ns
+    uint64_t wait_ns_total;  // time spent in wait_sector() since the aeronave was created
+    uint64_t waits;
+    int wait_result;         // set by the CCM before waking the aeronave: WAIT_GRANTED or WAIT_TIMED_OUT
+    uint64_t timeouts;       // requests that reached their deadline since the aeronave was created
+    uint64_t request_ns;     // when the pending request was sent, for the request-to-grant latency
+    int requested_sector;    // sector of the pending request (-1: none)
 }Aeronave;
 
 typedef struct{
     int id_sector;
     int id_aeronave;
-    int request_type; // 0 if it's for entrance, 1 if it's a flag that the sector is available
+    int request_type; // 0 if it's for entrance, 1 if it's a flag that the sector is available, 2 if it's a handoff (leave id_sector_from and enter id_sector)
+    int id_sector_from; // only used by handoff requests: the sector the aeronave is leaving (-1 otherwise)
+    uint64_t deadline_ns; // monotonic_ns() after which the aeronave stops waiting for id_sector (0: waits forever)
+    int tier;           // service tier, selects the request lane (releases always use tier 0)
 }RequestSector;
 
+// Service tiers: each tier has its own request lane, the CCM serves up to `weight` requests of a lane before giving the
+// lower tiers their turn, so between two tier 0 requests it serves at most the sum of the weights of the lower tiers
+#define NUM_SERVICE_TIERS 3
+#define SERVICE_TIER_0_MIN_PRIORITY 900 // priority 900-999
+#define SERVICE_TIER_1_MIN_PRIORITY 500 // priority 500-899, the others are tier 2
+
+typedef struct{
+    RequestSector * queue; // FIFO circular buffer (inside CentralizedControlMechanism.request_queue)
+    int front;             // index of the front element (where we dequeue)
+    int rear;              // index of the rear element (where we enqueue)
+    int count;
+    int capacity;          // size of the circular buffer
+    int weight;            // requests served in a row before the lower lanes get their turn
+    int credit;            // requests the lane can still be served in the current round
+}RequestLane;
+
 typedef struct{
     int id; 
-    pthread_mutex_t mutex_sector; // /!\ use only pthread_mutex_try_lock()
+    sem_t sector_lock; // binary semaphore, /!\ use only sem_trywait(); posted by the aeronave or by the CCM on a handoff
     int max_size;
     Aeronave ** waiting_list; // pointer to pointer, because it's an array for the pointers to Aeronaves
     int waiting_list_size;
 }MutexPriority;
 
+#define LATENCY_SUB_BUCKETS 16
+#define LATENCY_BUCKETS (61 * LATENCY_SUB_BUCKETS)
+
+typedef struct{
+    uint64_t counts[LATENCY_BUCKETS]; // log-linear buckets (see latency_bucket() in structures.c)
+    uint64_t total;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+}LatencyHistogram;
+
+// Published copy of a sector for the monitors (see snapshot_airspace()): the CCM writes it after each request
+typedef struct{
+    int busy;
+    int id_aeronave_occupying;
+    int waiting;        // length of the waiting list of the sector
+    int first_waiter_tier; // service tier of the first aeronave of the waiting list, NUM_SERVICE_TIERS if it's empty
+}SectorState;
+
+// consistent view of every sector at one point of the CCM's sequence of requests
+typedef struct{
+    uint64_t version;   // sequence number of the seqlock when the snapshot was taken (always even)
+    int number_sectors;
+    int occupied;
+    int waiting;        // aeronaves in all the waiting lists
+    SectorState * sectors;
+}AirspaceSnapshot;
+
+// Tracepoints on the life of a request: with -DTRACEPOINTS (make TRACE=1) each TRACE() is one branch on ccm->tracer
+// when tracing is off, and appends an event to the tracer when it's on; without it TRACE() compiles to nothing
+// (the arguments are only cast to void, they must not have side effects)
+typedef enum{
+    TRACE_ENQUEUE = 0,          // detail: request type
+    TRACE_DEQUEUE = 1,          // detail: request type
+    TRACE_GRANT = 2,            // the CCM gives the sector to the aeronave and posts its semaphore
+    TRACE_WAITLIST_INSERT = 3,
+    TRACE_WAITLIST_REMOVE = 4,  // detail: 0 granted, 1 timed out
+    TRACE_WAKE = 5,             // the aeronave returned from wait_sector(), detail: WAIT_GRANTED or WAIT_TIMED_OUT
+    TRACE_ACQUIRE = 6,
+    TRACE_RELEASE = 7
+}TraceEventType;
+#define NUM_TRACE_EVENTS 8
+#define TRACE_DEFAULT_CAPACITY (1 << 20) // events
+
+typedef struct{
+    uint64_t ts_ns;             // monotonic_ns()
+    int type;
+    int id_aeronave;
+    int id_sector;
+    int detail;
+}TraceEvent;
+
+// preallocated array filled by every thread (one atomic increment per event), written to a file at the end
+typedef struct{
+    TraceEvent * events;
+    long capacity;
+    long next;                  // events recorded (and dropped, past capacity)
+}Tracer;
+
+#ifdef TRACEPOINTS
+#define TRACE(ccm, type, id_aeronave, id_sector, detail) \
+    do { if (__builtin_expect((ccm)->tracer != NULL, 0)) trace_event((ccm)->tracer, type, id_aeronave, id_sector, detail); } while (0)
+#else
+#define TRACE(ccm, type, id_aeronave, id_sector, detail) do { (void)(id_aeronave); (void)(id_sector); (void)(detail); } while (0)
+#endif
+
+// Hierarchical timing wheel: WHEEL_LEVELS levels of WHEEL_SLOTS slots, each level WHEEL_SLOTS times coarser than
+// the previous one (1ms, 64ms, ~4s, ~4.5min per slot), so the wheel covers ~4.6h. A farther deadline is placed at the
+// end of that range, and placed again when it gets there. Timers are intrusive doubly linked nodes: adding and
+// cancelling are O(1) and never allocate.
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_TICK_NS 1000000ull
+
+typedef struct TimerNode{
+    struct TimerNode * next;
+    struct TimerNode * prev;
+    uint64_t expires;   // tick of the slot the timer is in
+    uint64_t deadline;  // tick at which the timer expires (after expires if it was beyond the range of the wheel)
+    int id_aeronave;
+    int id_sector;      // sector whose waiting list the aeronave is in
+    int armed;
+}TimerNode;
+
+typedef struct{
+    TimerNode slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+    uint64_t current_tick;                      // every tick up to this one has been processed
+    uint64_t start_ns;                          // time of tick 0
+    TimerNode * timers;                         // one per aeronave, an aeronave waits for one sector at a time
+    int num_timers;
+    long armed_count;
+}TimingWheel;
+
+typedef struct{
+    uint64_t * words; // bit i of words[i / 64] is sector i
+    int num_bits;
+    int num_words;
+}SectorBitmap;
+
+// Replication of the CCM to a hot standby: every change the CCM makes to the sectors and waiting lists is appended to
+// a log (single producer, single consumer ring), the standby thread applies it to its own copy of the state and takes
+// over when the CCM stops sending heartbeats
+#define REPLICATION_LOG_SIZE 65536 // events, power of 2
+
+typedef enum{
+    REPL_OCCUPY = 0,    // id_aeronave now occupies id_sector
+    REPL_FREE = 1,      // id_sector is free
+    REPL_WAIT = 2,      // id_aeronave entered the waiting list of id_sector at position (until deadline_ns, 0: forever)
+    REPL_UNWAIT = 3     // id_aeronave left the waiting list of id_sector (granted or timed out)
+}ReplicationEventType;
+
+typedef struct{
+    int type;
+    int id_sector;
+    int id_aeronave;
+    int position;       // REPL_WAIT: index in the waiting list of the primary (the priority of the aeronave may have changed since)
+    uint64_t deadline_ns;
+}ReplicationEvent;
+
+typedef struct{
+    ReplicationEvent * events;
+    uint64_t head;              // next event written by the primary
+    uint64_t tail;              // next event applied by the standby
+    // copy of the state, only used by the standby until it takes over
+    MutexPriority ** mutex_sections;
+    int * occupant;             // aeronave occupying each sector, -1 if free
+    uint64_t * deadline_ns;     // deadline of the request of each waiting aeronave
+    int num_sectors;
+    int num_aeronaves;
+    // failure detection and fencing
+    uint64_t heartbeat_ns;      // written by the primary at each turn of its loop
+    int heartbeat_timeout_ms;   // the standby takes over after this long without heartbeat
+    int epoch;                  // incremented by the standby when it takes over: the old primary stops
+    int in_request;             // 1 while the primary is processing a request (the takeover waits for it)
+    long kill_after_requests;   // fault injection: the primary dies after this many requests (0: never)
+    long requests;              // requests processed by the primary
+    int primary_done;           // set by the CCM loop when it ends normally (stop, lanes empty)
+    // measures
+    uint64_t events_total;
+    uint64_t log_full_waits;    // times the primary waited for the standby because the log was full
+    int failovers;
+    uint64_t failover_silence_ns;  // time between the last heartbeat of the primary and the end of the takeover
+    uint64_t failover_takeover_ns; // time the takeover itself took
+    uint64_t replayed_at_takeover; // events still in the log when the standby noticed the failure
+}Replication;
+
 typedef struct{
     MutexPriority ** mutex_sections; /* array of pointers to MutexPriority (one per sector) */
     int num_mutex_sections;          /* number of entries in mutex_sections */
-    RequestSector * request_queue;   /* array of RequestSector objects acting as a FIFO queue */
-    int request_queue_size;          /* maximum size of the request queue */
-    int request_queue_front;         /* index of the front element (where we dequeue) */
-    int request_queue_rear;          /* index of the rear element (where we enqueue) */
-    int request_queue_count;         /* current number of requests in the queue */
+    RequestSector * request_queue;   /* storage of the request lanes (request_queue_size requests per lane) */
+    RequestLane request_lanes[NUM_SERVICE_TIERS]; /* one FIFO queue per service tier */
+    int request_queue_size;          /* maximum size of each request lane */
+    int request_queue_count;         /* current number of requests in all the lanes */
     pthread_mutex_t mutex_request;   /* mutex to protect `request_queue` : one request at a time */
     sem_t * semaphores_aeronaves;   /* array of semaphores to avoid busy waiting */
     int num_semaphores_aeronaves;
+    int max_dwell_ms;                /* each aeronave stays between 1 and max_dwell_ms ms in a sector (default 5) */
+    int verbose;                     /* 0 silences the LOG() messages (the errors are always printed) */
+    WaitStrategy wait_strategy;      /* how the aeronaves wait in wait_sector() (default WAIT_BLOCK) */
+    int request_timeout_ms;          /* deadline of the entrance requests, 0 to wait forever (default) */
+    int reroute_on_timeout;          /* 1: after a timeout the aeronave picks another sector, 0: it retries the same one */
+    TimingWheel * wait_timers;       /* deadlines of the aeronaves in the waiting lists (only used by the CCM thread) */
+    LatencyHistogram grant_latency[NUM_SERVICE_TIERS]; /* request-to-grant time per tier (written by the CCM thread) */
+    SectorBitmap * occupied_sectors; /* bit set while the sector is busy (maintained by the CCM thread) */
+    SectorBitmap * waiting_sectors;  /* bit set while the waiting list of the sector is not empty */
+    SectorState * airspace;          /* copy of the sectors read by the monitors, written by the CCM thread only */
+    uint64_t airspace_seq;           /* seqlock of airspace: odd while the CCM is writing it */
+    Replication * replication;       /* hot standby (NULL: none) */
+    Tracer * tracer;                 /* tracepoints (NULL: off, see TRACE()) */
 }CentralizedControlMechanism;
 
-// global variables
-extern Sector ** sectors;
-extern Aeronave ** aeronaves;
-extern CentralizedControlMechanism * centralized_control_mechanism;
+// simulation handle: there are no global variables, every function that needs the state of a simulation receives it
+typedef struct{
+    Sector ** sectors;
+    int number_sectors;
+    Aeronave ** aeronaves;
+    int number_aeronaves;
+    CentralizedControlMechanism * ccm;
+    unsigned int seed;     // rand_r() state used when creating aeronaves and routes
+    int procedural_routes; // create_aeronave() and reset_aeronave() give procedural routes instead of rota arrays
+    volatile int stop;     // set by the caller to end run_centralized_control() (once no aeronave sends requests)
+}Simulation;
+
+// prints only if the ccm is verbose, used for the trace of the simulation (errors use printf directly)
+#define LOG(ccm, ...) do { if ((ccm)->verbose) printf(__VA_ARGS__); } while (0)
 
 // Sectors list fonctions 
 Sector* create_sector(int number_sectors);
+void destroy_sector(Sector * sector);
 void destroy_sectors(Sector * sectors); 
 int insert_sector(Sector * sectors, Sector sector);
 Sector remove_sector(Sector * sectors, int number_sectors, int id_sector);
@@ -63,15 +280,33 @@ int is_empty_sectors(Sector * sectors, int number_sectors);
 int is_full_sectors(Sector * sectors, int number_sectors);
 
 // Aeronave functions
-Aeronave* create_aeronave(int id, int priority, int tam_rota);
-void init_aeronave(Aeronave * aeronave);
+Aeronave* create_aeronave(Simulation * sim, int id, int priority, int tam_rota);
+int reset_aeronave(Simulation * sim, Aeronave * aeronave, int priority, int tam_rota);
+int set_aeronave_rota(Simulation * sim, Aeronave * aeronave, const int * rota, int tam_rota);
+int load_routes_file(Simulation * sim, const char * path);
+int aeronave_route_sector(Simulation * sim, Aeronave * aeronave, int index);
+int reroute_aeronave(Simulation * sim, Aeronave * aeronave);
+void init_aeronave(Simulation * sim, Aeronave * aeronave);
+void destroy_aeronave(Aeronave * aeronave);
 void destroy_aeronaves(Aeronave * aeronaves);
-int request_sector(Aeronave * aeronave, int id_sector);
-int wait_sector(Aeronave * aeronave);
-int acquire_sector(Aeronave * aeronave, Sector * sector);
-Sector* release_sector(Aeronave * aeronave, Sector* to_release);
+int request_sector(Simulation * sim, Aeronave * aeronave, int id_sector);
+int wait_sector(Simulation * sim, Aeronave * aeronave);
+int acquire_sector(Simulation * sim, Aeronave * aeronave, Sector * sector);
+Sector* unlock_sector(Simulation * sim, Aeronave * aeronave, Sector* to_release);
+Sector* release_sector(Simulation * sim, Aeronave * aeronave, Sector* to_release);
 int repeat(Aeronave * aeronave);
 
+// WaitStrategy functions
+const char* wait_strategy_name(WaitStrategy strategy);
+int parse_wait_strategy(const char * name);
+
+// Time and LatencyHistogram functions
+uint64_t monotonic_ns(void);
+void latency_histogram_init(LatencyHistogram * histogram);
+void latency_histogram_record(LatencyHistogram * histogram, uint64_t ns);
+uint64_t latency_histogram_percentile(LatencyHistogram * histogram, double p);
+uint64_t latency_histogram_mean(LatencyHistogram * histogram);
+
 //RequestSector
 RequestSector create_request(int number_sectors, int number_aeronaves);
 void destroy_requests(RequestSector * requests);
@@ -80,11 +315,32 @@ void destroy_requests(RequestSector * requests);
 MutexPriority* create_mutex_priority(int max_size, int id);
 void destroy_mutex_priority(MutexPriority * mutex_priority);
 int order_list_by_priority(MutexPriority * mutex_priority); // max size is the number of aeronaves
-void insert_aeronave_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave);
+int insert_aeronave_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave);
+void insert_aeronave_at_mutex_priority(MutexPriority * mutex_priority, Aeronave * aeronave, int position);
 Aeronave* remove_aeronave_mutex_priority(MutexPriority * mutex_priority);
+Aeronave* remove_aeronave_by_id_mutex_priority(MutexPriority * mutex_priority, int id_aeronave);
 int is_empty_mutex_priority(MutexPriority * mutex_priority);
 int is_full_mutex_priority(MutexPriority * mutex_priority);
 
+// TimingWheel functions (no mutual exclusion, only the CCM thread uses its wheel)
+TimingWheel* create_timing_wheel(int num_timers, uint64_t start_ns);
+void destroy_timing_wheel(TimingWheel * wheel);
+void timing_wheel_add(TimingWheel * wheel, int id_aeronave, int id_sector, uint64_t deadline_ns);
+void timing_wheel_cancel(TimingWheel * wheel, int id_aeronave);
+int timing_wheel_advance(TimingWheel * wheel, uint64_t now_ns, void (*expire)(TimerNode * timer, void * arg), void * arg);
+
+// SectorBitmap functions (no mutual exclusion, only the CCM thread changes its bitmaps)
+SectorBitmap* create_sector_bitmap(int num_bits);
+void destroy_sector_bitmap(SectorBitmap * bitmap);
+void sector_bitmap_set(SectorBitmap * bitmap, int bit);
+void sector_bitmap_clear(SectorBitmap * bitmap, int bit);
+int sector_bitmap_test(SectorBitmap * bitmap, int bit);
+int sector_bitmap_count(SectorBitmap * bitmap);
+int sector_bitmap_find_first_set(SectorBitmap * bitmap);
+int sector_bitmap_find_first_clear(SectorBitmap * bitmap);
+int sector_bitmap_count_and(SectorBitmap * bitmap, SectorBitmap * mask);
+int sector_bitmap_find_first_clear_in(SectorBitmap * bitmap, SectorBitmap * mask);
+
 // CentralizedControlMechanism functions
 CentralizedControlMechanism* create_centralized_control_mechanism(int sectors_number, int aeronaves_number);
 void init_centralized_control(CentralizedControlMechanism * ccm);
@@ -93,11 +349,41 @@ int prevent_deadlock(RequestSector* requests, MutexPriority * mutex_priorities,
 // thought of smth like this: if an aeronave tries to acquire the access to the next sector, there will be a timeout
 // if it times out, it stops trying to acquire the next sector, waits a little bit (important to be a random time) and then
 // tries again
+// (done with the request deadlines: see request_timeout_ms and expire_wait_timeouts())
 Sector* get_next_sector(Aeronave * aeronave, Sector * sectors, int number_sectors);
 void destroy_centralized_control_mechanism(CentralizedControlMechanism * ccm);
 int enqueue_request(CentralizedControlMechanism * ccm, RequestSector * request);
 RequestSector* dequeue_request(CentralizedControlMechanism * ccm);
 int is_request_queue_empty(CentralizedControlMechanism * ccm);
-Sector* control_priority(RequestSector* request, MutexPriority ** mutex_priorities, pthread_mutex_t * mutex_request);
+int service_tier(int priority);
+int count_occupied_sectors(CentralizedControlMechanism * ccm);
+int count_waiting_sectors(CentralizedControlMechanism * ccm);
+int check_sector_bitmaps(Simulation * sim);
+int expire_wait_timeouts(Simulation * sim);
+Sector* control_priority(Simulation * sim, RequestSector* request);
+
+// Monitor functions (any thread, they never block the CCM)
+AirspaceSnapshot* create_airspace_snapshot(Simulation * sim);
+void destroy_airspace_snapshot(AirspaceSnapshot * snapshot);
+int snapshot_airspace(Simulation * sim, AirspaceSnapshot * snapshot);
+
+// Replication functions (one primary and one standby)
+Replication* create_replication(Simulation * sim, int heartbeat_timeout_ms);
+void destroy_replication(Replication * replication);
+void run_standby_ccm(Simulation * sim); // standby thread body: applies the log, takes over on heartbeat timeout
+
+// Tracer functions
+Tracer* create_tracer(long capacity);
+void destroy_tracer(Tracer * tracer);
+void trace_event(Tracer * tracer, int type, int id_aeronave, int id_sector, int detail);
+long write_trace(Tracer * tracer, const char * path);
+const char* trace_event_name(int type);
+int parse_trace_event(const char * name);
+
+// Simulation functions
+Simulation* create_simulation(int number_sectors, int number_aeronaves, unsigned int seed);
+void destroy_simulation(Simulation * sim);
+void run_centralized_control(Simulation * sim); // CCM thread body, returns when sim->stop is set and the lanes are empty
+void run_shared_centralized_control(Simulation ** sims, int num_sims); // one CCM thread for several simulations
 
 #endif
\ No newline at end of file
@@ -0,0 +1,222 @@
+#define _DEFAULT_SOURCE  // Enable mkdtemp and other POSIX features
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Parameter sweep: runs ./trabalho_final once per point of the grid (times the repetitions), with up to one
+// simulation per core at the same time, and aggregates the csv row of every run in a single csv file.
+// Each run gets its own seed (base seed + run index), so the same sweep can be repeated.
+
+#define MAX_VALUES 64
+
+typedef struct{
+    char *values[MAX_VALUES];
+    int count;
+}ValueList;
+
+typedef struct{
+    char sectors[16];
+    char aeronaves[16];
+    char dwell[16];
+    char rate[16];
+    char wait[16];
+    unsigned int seed;
+    char row_path[256];
+    pid_t pid;
+    int exit_failed; // the simulator exited with a non-zero status or was killed by a signal
+}Run;
+
+char *simulator = "./trabalho_final";
+char *duration = "10";
+char *warmup = "2";
+
+// splits "a,b,c" in place
+static int parse_list(char *arg, ValueList *list) {
+    list->count = 0;
+    for (char *tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (list->count == MAX_VALUES) return -1;
+        list->values[list->count++] = tok;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+static void usage(char *name) {
+    printf("Usage : %s [-j jobs] [-n repetitions] [-b base_seed] [-o results.csv] [-x simulator] [-t duration_s] [-w warmup_s]\n", name);
+    printf("        -S sectors_list -A aeronaves_list [-D max_dwell_ms_list] [-R arrival_rate_list] [-W wait_strategy_list]\n");
+    printf("  lists are comma separated, e.g. -S 5,10,20; an arrival rate of 0 means closed mode\n");
+    printf("  -j  simulations running at the same time (default: number of online cores)\n");
+    printf("  -n  runs per point of the grid, each one with a different seed (default 1)\n");
+}
+
+static pid_t start_run(Run *run) {
+    // the child gets a copy of the stdio buffers: flushed now, or they are written again by the child
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        char seed[16];
+        snprintf(seed, sizeof(seed), "%u", run->seed);
+        char *args[24];
+        int n = 0;
+        args[n++] = simulator;
+        args[n++] = "-q";
+        args[n++] = "-s"; args[n++] = seed;
+        args[n++] = "-d"; args[n++] = run->dwell;
+        args[n++] = "-W"; args[n++] = run->wait;
+        args[n++] = "-o"; args[n++] = run->row_path;
+        if (atof(run->rate) > 0) {
+            args[n++] = "-r"; args[n++] = run->rate;
+            args[n++] = "-t"; args[n++] = duration;
+            args[n++] = "-w"; args[n++] = warmup;
+        }
+        args[n++] = run->sectors;
+        args[n++] = run->aeronaves;
+        args[n] = NULL;
+        // the simulator only prints a short report in quiet mode, it isn't needed here
+        if (freopen("/dev/null", "w", stdout) == NULL) _exit(127);
+        execv(simulator, args);
+        perror("[SWEEP] execv");
+        _exit(127);
+    }
+    return pid;
+}
+
+// copies the rows of every run (and the header of the first one) to out, in run order
+static int aggregate(Run *runs, int num_runs, FILE *out) {
+    int header_written = 0;
+    int failed = 0;
+    char line[1024];
+    for (int i = 0; i < num_runs; i++) {
+        if (runs[i].exit_failed) { // its results may be partial: they aren't kept
+            failed++;
+            unlink(runs[i].row_path);
+            continue;
+        }
+        FILE *f = fopen(runs[i].row_path, "r");
+        if (!f) {
+            printf("[SWEEP] Error: run %d (%s sectors, %s aeronaves) produced no results\n", i, runs[i].sectors, runs[i].aeronaves);
+            failed++;
+            continue;
+        }
+        int first = 1;
+        while (fgets(line, sizeof(line), f)) {
+            if (first && header_written) { first = 0; continue; }
+            fputs(line, out);
+            first = 0;
+            header_written = 1;
+        }
+        fclose(f);
+        unlink(runs[i].row_path);
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    ValueList sectors = {{0}, 0}, aeronaves = {{0}, 0}, dwells = {{0}, 0}, rates = {{0}, 0}, waits = {{0}, 0};
+    char default_dwell[] = "5", default_rate[] = "0", default_wait[] = "block";
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int repetitions = 1;
+    unsigned int base_seed = 1;
+    char *out_path = "sweep_results.csv";
+    int opt;
+    while ((opt = getopt(argc, argv, "j:n:b:o:x:t:w:S:A:D:R:W:")) != -1) {
+        int rc = 0;
+        switch (opt) {
+            case 'j': jobs = atol(optarg); break;
+            case 'n': repetitions = atoi(optarg); break;
+            case 'b': base_seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'o': out_path = optarg; break;
+            case 'x': simulator = optarg; break;
+            case 't': duration = optarg; break;
+            case 'w': warmup = optarg; break;
+            case 'S': rc = parse_list(optarg, &sectors); break;
+            case 'A': rc = parse_list(optarg, &aeronaves); break;
+            case 'D': rc = parse_list(optarg, &dwells); break;
+            case 'R': rc = parse_list(optarg, &rates); break;
+            case 'W': rc = parse_list(optarg, &waits); break;
+            default: usage(argv[0]); return 1;
+        }
+        if (rc < 0) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sectors.count == 0 || aeronaves.count == 0 || jobs < 1 || repetitions < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (dwells.count == 0) parse_list(default_dwell, &dwells);
+    if (rates.count == 0) parse_list(default_rate, &rates);
+    if (waits.count == 0) parse_list(default_wait, &waits);
+
+    char tmp_dir[] = "/tmp/sweep_XXXXXX";
+    if (!mkdtemp(tmp_dir)) {
+        perror("[SWEEP] mkdtemp");
+        return 1;
+    }
+
+    int num_runs = sectors.count * aeronaves.count * dwells.count * rates.count * waits.count * repetitions;
+    Run *runs = malloc(sizeof(Run) * num_runs);
+    int n = 0;
+    for (int s = 0; s < sectors.count; s++)
+        for (int a = 0; a < aeronaves.count; a++)
+            for (int d = 0; d < dwells.count; d++)
+                for (int r = 0; r < rates.count; r++)
+                    for (int w = 0; w < waits.count; w++)
+                        for (int k = 0; k < repetitions; k++) {
+                            Run *run = &runs[n];
+                            snprintf(run->sectors, sizeof(run->sectors), "%s", sectors.values[s]);
+                            snprintf(run->aeronaves, sizeof(run->aeronaves), "%s", aeronaves.values[a]);
+                            snprintf(run->dwell, sizeof(run->dwell), "%s", dwells.values[d]);
+                            snprintf(run->rate, sizeof(run->rate), "%s", rates.values[r]);
+                            snprintf(run->wait, sizeof(run->wait), "%s", waits.values[w]);
+                            run->seed = base_seed + n;
+                            snprintf(run->row_path, sizeof(run->row_path), "%s/run_%d.csv", tmp_dir, n);
+                            run->pid = -1;
+                            run->exit_failed = 0;
+                            n++;
+                        }
+
+    printf("[SWEEP] %d runs, %ld at a time\n", num_runs, jobs);
+    int next = 0, running = 0, done = 0;
+    while (done < num_runs) {
+        while (running < jobs && next < num_runs) {
+            runs[next].pid = start_run(&runs[next]);
+            if (runs[next].pid < 0) {
+                perror("[SWEEP] fork");
+                break;
+            }
+            next++;
+            running++;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) break;
+        running--;
+        done++;
+        for (int i = 0; i < next; i++) {
+            if (runs[i].pid == pid && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                runs[i].exit_failed = 1;
+                if (WIFSIGNALED(status)) printf("[SWEEP] Error: run %d (seed %u) killed by signal %d\n", i, runs[i].seed, WTERMSIG(status));
+                else printf("[SWEEP] Error: run %d (seed %u) exited with status %d\n", i, runs[i].seed, WEXITSTATUS(status));
+            }
+        }
+        printf("[SWEEP] %d/%d runs done\n", done, num_runs);
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror("[SWEEP] fopen");
+        free(runs);
+        return 1;
+    }
+    int failed = aggregate(runs, num_runs, out);
+    fclose(out);
+    rmdir(tmp_dir);
+    free(runs);
+    printf("[SWEEP] Results written to %s (%d runs failed)\n", out_path, failed);
+    return failed ? 1 : 0;
+}
@@ -4,42 +4,29 @@
 #include <string.h>
 #include "structures.h"
 
-// Define the globals declared as extern in structures.h for the test
-Sector *sectors = NULL;
-Aeronave *aeronaves = NULL;
-CentralizedControlMechanism *centralized_control_mechanism = NULL;
-
 int main(void) {
     int number_aeronaves = 3;
     int number_sectors = 3;
     printf("[TEST] Starting centralized control mechanism tests with request queue\n");
 
-    // Allocate sectors and aeronaves globals
-    sectors = malloc(sizeof(Sector) * number_sectors);
-    aeronaves = malloc(sizeof(Aeronave) * number_aeronaves);
-    if (!sectors || !aeronaves) {
-        printf("[TEST][ERROR] Failed to allocate globals\n");
-        return 1;
-    }
-    for (int i = 0; i < number_sectors; ++i) sectors[i].id = i;
-    for (int i = 0; i < number_aeronaves; ++i) { aeronaves[i].id = i; aeronaves[i].priority = i; }
-
-    // Create centralized control mechanism
-    centralized_control_mechanism = create_centralized_control_mechanism(number_aeronaves);
-    if (!centralized_control_mechanism) {
-        printf("[TEST][FAIL] create_centralized_control_mechanism returned NULL\n");
-        free(sectors); free(aeronaves);
+    // Create the simulation (sectors, aeronaves and centralized control mechanism)
+    Simulation *sim = create_simulation(number_sectors, number_aeronaves, 0);
+    if (!sim) {
+        printf("[TEST][FAIL] create_simulation returned NULL\n");
         return 1;
     }
-    printf("[TEST][OK] create_centralized_control_mechanism returned non-NULL\n");
+    printf("[TEST][OK] create_simulation returned non-NULL\n");
+    sim->ccm->verbose = 0;
+    for (int i = 0; i < number_aeronaves; ++i) sim->aeronaves[i] = create_aeronave(sim, i, i, 1);
+    CentralizedControlMechanism *centralized_control_mechanism = sim->ccm;
     printf("[TEST][OK] Request queue size: %d\n", centralized_control_mechanism->request_queue_size);
 
     // Test 1: Test enqueue_request - add multiple requests to queue
     printf("\n[TEST] Test 1: Enqueue multiple requests\n");
     RequestSector req1, req2, req3;
-    req1.id_sector = 0; req1.id_aeronave = 0;
-    req2.id_sector = 1; req2.id_aeronave = 1;
-    req3.id_sector = 2; req3.id_aeronave = 2;
+    req1.id_sector = 0; req1.id_aeronave = 0; req1.request_type = 0; req1.id_sector_from = -1; req1.tier = 0;
+    req2.id_sector = 1; req2.id_aeronave = 1; req2.request_type = 0; req2.id_sector_from = -1; req2.tier = 0;
+    req3.id_sector = 2; req3.id_aeronave = 2; req3.request_type = 0; req3.id_sector_from = -1; req3.tier = 0;
     
     if (enqueue_request(centralized_control_mechanism, &req1) == 0) {
         printf("[TEST][OK] Enqueued request 1\n");
@@ -108,18 +95,150 @@ int main(void) {
     RequestSector req_for_priority;
     req_for_priority.id_sector = 1;
     req_for_priority.id_aeronave = 1;
+    req_for_priority.request_type = 0;
+    req_for_priority.id_sector_from = -1;
+    req_for_priority.tier = 0;
+    req_for_priority.deadline_ns = 0;
     
-    Sector *res = control_priority(&req_for_priority, centralized_control_mechanism->mutex_sections, &centralized_control_mechanism->mutex_request);
-    if (res != NULL && res == &sectors[req_for_priority.id_sector]) {
+    Sector *res = control_priority(sim, &req_for_priority);
+    if (res != NULL && res == sim->sectors[req_for_priority.id_sector]) {
         printf("[TEST][OK] control_priority acquired sector successfully\n");
     } else {
         printf("[TEST][FAIL] control_priority did not acquire sector\n");
     }
 
+    // Test 5: snapshots of the airspace see what control_priority changed
+    printf("\n[TEST] Test 5: Test snapshot_airspace\n");
+    RequestSector req_waiting = req_for_priority;
+    req_waiting.id_aeronave = 2;
+    req_waiting.deadline_ns = 0;
+    control_priority(sim, &req_waiting); // sector 1 is busy, aeronave 2 waits for it
+    AirspaceSnapshot *snapshot = create_airspace_snapshot(sim);
+    int retries = snapshot_airspace(sim, snapshot);
+    if (retries == 0 && snapshot->occupied == 1 && snapshot->waiting == 1) {
+        printf("[TEST][OK] Snapshot has 1 occupied sector and 1 waiting aeronave\n");
+    } else {
+        printf("[TEST][FAIL] Snapshot has %d occupied sectors and %d waiting aeronaves\n", snapshot->occupied, snapshot->waiting);
+    }
+    if (snapshot->sectors[1].busy && snapshot->sectors[1].id_aeronave_occupying == 1 && snapshot->sectors[1].waiting == 1) {
+        printf("[TEST][OK] Sector 1 is occupied by aircraft 1 with 1 aircraft waiting\n");
+    } else {
+        printf("[TEST][FAIL] Sector 1 state is wrong in the snapshot\n");
+    }
+    uint64_t version = snapshot->version;
+    RequestSector req_release = req_for_priority;
+    req_release.request_type = 1;
+    control_priority(sim, &req_release); // aeronave 1 leaves, aeronave 2 gets the sector
+    snapshot_airspace(sim, snapshot);
+    if (snapshot->version > version && snapshot->sectors[1].id_aeronave_occupying == 2 && snapshot->waiting == 0) {
+        printf("[TEST][OK] Newer snapshot shows the sector handed to aircraft 2\n");
+    } else {
+        printf("[TEST][FAIL] Newer snapshot doesn't show the release\n");
+    }
+    destroy_airspace_snapshot(snapshot);
+
+    // Test 6: the lanes are served 8:3:1 (weights of the tiers 0, 1 and 2)
+    printf("\n[TEST] Test 6: Test the weighted order of the request lanes\n");
+    Simulation *lanes_sim = create_simulation(3, 24, 0); // lanes of 24 requests
+    lanes_sim->ccm->verbose = 0;
+    int per_tier[NUM_SERVICE_TIERS] = {16, 6, 2}; // two full rounds
+    RequestSector lane_req = req1;
+    for (int t = 0; t < NUM_SERVICE_TIERS; t++) {
+        for (int i = 0; i < per_tier[t]; i++) {
+            lane_req.tier = t;
+            lane_req.id_aeronave = i;
+            enqueue_request(lanes_sim->ccm, &lane_req);
+        }
+    }
+    int expected_tiers[24], in_order = 1, in_fifo = 1, next_id[NUM_SERVICE_TIERS] = {0};
+    for (int round = 0, k = 0; round < 2; round++) {
+        for (int i = 0; i < 12; i++, k++) expected_tiers[k] = i < 8 ? 0 : (i < 11 ? 1 : 2);
+    }
+    for (int k = 0; k < 24; k++) {
+        RequestSector *r = dequeue_request(lanes_sim->ccm);
+        if (!r || r->tier != expected_tiers[k]) { in_order = 0; break; }
+        if (r->id_aeronave != next_id[r->tier]++) in_fifo = 0;
+    }
+    if (in_order && in_fifo && is_request_queue_empty(lanes_sim->ccm)) {
+        printf("[TEST][OK] Two rounds of 8 tier 0, 3 tier 1 and 1 tier 2 requests, each lane in FIFO order\n");
+    } else {
+        printf("[TEST][FAIL] Lanes weren't served 8:3:1 in FIFO order\n");
+    }
+    // a lane without credit still goes on when the other lanes are empty
+    for (int i = 0; i < 3; i++) {
+        lane_req.tier = 2;
+        lane_req.id_aeronave = i;
+        enqueue_request(lanes_sim->ccm, &lane_req);
+    }
+    int served = 0;
+    while (dequeue_request(lanes_sim->ccm) != NULL) served++;
+    if (served == 3) {
+        printf("[TEST][OK] Tier 2 alone is served without waiting for the other lanes\n");
+    } else {
+        printf("[TEST][FAIL] Tier 2 alone served %d requests (expected 3)\n", served);
+    }
+    destroy_simulation(lanes_sim);
+
+    // Test 7: a handoff frees a sector, it goes in the lane of the first aeronave waiting for that sector
+    printf("\n[TEST] Test 7: Test the lane of a handoff\n");
+    Simulation *handoff_sim = create_simulation(2, 3, 0);
+    handoff_sim->ccm->verbose = 0;
+    handoff_sim->aeronaves[0] = create_aeronave(handoff_sim, 0, 100, 2); // tier 2, in sector 0
+    handoff_sim->aeronaves[1] = create_aeronave(handoff_sim, 1, 950, 1); // tier 0, waits for sector 0
+    handoff_sim->aeronaves[2] = create_aeronave(handoff_sim, 2, 100, 1); // in sector 1
+    RequestSector setup = req_for_priority;
+    setup.id_aeronave = 0; setup.id_sector = 0;
+    control_priority(handoff_sim, &setup);
+    setup.id_aeronave = 2; setup.id_sector = 1;
+    control_priority(handoff_sim, &setup);
+    handoff_sim->aeronaves[0]->current_sector = handoff_sim->sectors[0];
+    request_sector(handoff_sim, handoff_sim->aeronaves[0], 1);
+    RequestSector *without_waiter = dequeue_request(handoff_sim->ccm);
+    setup.id_aeronave = 1; setup.id_sector = 0;
+    control_priority(handoff_sim, &setup);
+    request_sector(handoff_sim, handoff_sim->aeronaves[0], 1);
+    RequestSector *with_waiter = dequeue_request(handoff_sim->ccm);
+    if (without_waiter && without_waiter->request_type == 2 && without_waiter->tier == 2) {
+        printf("[TEST][OK] Handoff of a tier 2 aeronave without waiters goes in lane 2\n");
+    } else {
+        printf("[TEST][FAIL] Handoff without waiters isn't in lane 2\n");
+    }
+    if (with_waiter && with_waiter->request_type == 2 && with_waiter->tier == 0) {
+        printf("[TEST][OK] Handoff freeing a sector a tier 0 aeronave waits for goes in lane 0\n");
+    } else {
+        printf("[TEST][FAIL] Handoff freeing a sector a tier 0 aeronave waits for isn't in lane 0\n");
+    }
+    destroy_simulation(handoff_sim);
+
+    // Test 8: the tier 0 lane also carries the releases: it holds twice as many requests as the others
+    printf("\n[TEST] Test 8: Test the size of the lanes\n");
+    Simulation *size_sim = create_simulation(2, 3, 0);
+    size_sim->ccm->verbose = 0;
+    RequestSector fill = req1;
+    int accepted[NUM_SERVICE_TIERS] = {0};
+    for (int t = 0; t < 2; t++) {
+        fill.tier = t;
+        for (int i = 0; i < 6; i++) {
+            fill.id_aeronave = i % 3;
+            if (enqueue_request(size_sim->ccm, &fill) == 0) accepted[t]++; // prints an error once a lane is full
+        }
+    }
+    if (accepted[0] == 6 && accepted[1] == 3) {
+        printf("[TEST][OK] Lane 0 holds 6 requests and lane 1 holds 3 for 3 aeronaves\n");
+    } else {
+        printf("[TEST][FAIL] Lane 0 held %d requests and lane 1 held %d (expected 6 and 3)\n", accepted[0], accepted[1]);
+    }
+    int drained = 0;
+    while (dequeue_request(size_sim->ccm) != NULL) drained++;
+    if (drained == 9) {
+        printf("[TEST][OK] Every queued request is dequeued\n");
+    } else {
+        printf("[TEST][FAIL] %d requests dequeued (expected 9)\n", drained);
+    }
+    destroy_simulation(size_sim);
+
     // Cleanup
-    destroy_centralized_control_mechanism(centralized_control_mechanism);
-    free(sectors);
-    free(aeronaves);
+    destroy_simulation(sim);
 
     printf("\n[TEST] All tests completed\n");
     return 0;
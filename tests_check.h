@@ -0,0 +1,21 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+
+// check() shared by the tests_*.c programs: prints [TEST][OK] / [TEST][FAIL] and counts the failures,
+// main() returns failures ? 1 : 0
+
+static int failures = 0;
+
+static void check(int condition, char *message){
+    if(condition){
+        printf("[TEST][OK] %s\n", message);
+    }
+    else{
+        printf("[TEST][FAIL] %s\n", message);
+        failures++;
+    }
+}
+
+#endif
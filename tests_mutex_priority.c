@@ -4,7 +4,7 @@
 #include <time.h>
 #include "structures.h"
 
-int main(void){ // IMPORTANT: COMPILE WITH THE COMMAND: gcc tests_mutex_priority.c structures.c -o tests_mutex_priority
+int main(void){ // compile with: make tests_mutex_priority
     srand(time(NULL));
 
     int n = 8;
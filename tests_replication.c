@@ -0,0 +1,123 @@
+#define _DEFAULT_SOURCE  // Enable usleep and other POSIX features
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "structures.h"
+#include "tests_check.h"
+
+static void send(Simulation *sim, int type, int id_aeronave, int id_sector, int id_sector_from, uint64_t deadline_ns){
+    RequestSector req;
+    req.request_type = type;
+    req.id_aeronave = id_aeronave;
+    req.id_sector = id_sector;
+    req.id_sector_from = id_sector_from;
+    req.deadline_ns = deadline_ns;
+    req.tier = 0;
+    control_priority(sim, &req);
+}
+
+static void* standby(void *arg){
+    run_standby_ccm((Simulation *)arg);
+    return NULL;
+}
+
+int main(void){ // compile with: make tests_replication
+    int num_sectors = 4, num_aeronaves = 6;
+    Simulation *sim = create_simulation(num_sectors, num_aeronaves, 7);
+    sim->ccm->verbose = 0;
+    sim->procedural_routes = 1;
+    int priorities[] = {10, 500, 900, 20, 30, 40};
+    for(int i = 0; i < num_aeronaves; i++) sim->aeronaves[i] = create_aeronave(sim, i, priorities[i], 3);
+
+    Replication *r = create_replication(sim, 1000);
+    check(r != NULL && sim->ccm->replication == r, "standby attached to the CCM");
+    pthread_t standby_thread;
+    pthread_create(&standby_thread, NULL, standby, sim);
+
+    // this thread plays the primary CCM (it never sends heartbeats, so the standby only follows the log)
+    uint64_t far = monotonic_ns() + 3600ull * 1000000000ull;
+    send(sim, 0, 0, 0, -1, 0);                      // aeronave 0 gets sector 0
+    send(sim, 0, 1, 0, -1, far);                    // aeronaves 1 and 2 wait for it, 1 with a deadline
+    send(sim, 0, 2, 0, -1, 0);
+    send(sim, 0, 3, 1, -1, 0);                      // aeronave 3 gets sector 1, then hands it off for sector 2
+    send(sim, 2, 3, 2, 1, 0);
+    send(sim, 0, 4, 2, -1, far);                    // aeronave 4 waits for sector 2
+    send(sim, 0, 5, 2, -1, monotonic_ns());         // aeronave 5 waits for sector 2, but its deadline has passed
+    usleep(2000);
+    check(expire_wait_timeouts(sim) == 1, "the request of aeronave 5 timed out");
+    send(sim, 1, 0, 0, -1, 0);                      // aeronave 0 leaves sector 0: aeronave 2 (priority 900) gets it
+    check(r->events_total == 11, "every change of the CCM is in the log");
+
+    // expected state, then the state of the primary is lost
+    int occupant[4], waiting[4], first_waiting[4];
+    for(int i = 0; i < num_sectors; i++){
+        occupant[i] = sim->sectors[i]->busy ? sim->sectors[i]->id_aeronave_occupying : -1;
+        waiting[i] = sim->ccm->mutex_sections[i]->waiting_list_size;
+        first_waiting[i] = waiting[i] ? sim->ccm->mutex_sections[i]->waiting_list[0]->id : -1;
+    }
+    long armed = sim->ccm->wait_timers->armed_count;
+    check(occupant[0] == 2 && waiting[0] == 1 && first_waiting[0] == 1, "sector 0: aeronave 2, aeronave 1 waiting");
+    check(occupant[1] == -1 && occupant[2] == 3 && waiting[2] == 1 && first_waiting[2] == 4, "sector 1 free, sector 2: aeronave 3, aeronave 4 waiting");
+    for(int i = 0; i < num_sectors; i++){
+        sim->sectors[i]->busy = 0;
+        sim->sectors[i]->id_aeronave_occupying = -1;
+        sim->ccm->mutex_sections[i]->waiting_list_size = 0;
+    }
+    for(int i = 0; i < num_aeronaves; i++) timing_wheel_cancel(sim->ccm->wait_timers, i);
+
+    // the primary stops sending heartbeats: the standby takes over with its copy
+    __atomic_store_n(&r->heartbeat_ns, 1, __ATOMIC_RELEASE);
+    for(int i = 0; i < 5000 && __atomic_load_n(&r->failovers, __ATOMIC_ACQUIRE) == 0; i++) usleep(1000);
+    check(r->failovers == 1 && r->epoch == 1, "the standby took over");
+    sim->stop = 1;
+    pthread_join(standby_thread, NULL);
+
+    int same = 1;
+    for(int i = 0; i < num_sectors; i++){
+        int o = sim->sectors[i]->busy ? sim->sectors[i]->id_aeronave_occupying : -1;
+        MutexPriority *mp = sim->ccm->mutex_sections[i];
+        if(o != occupant[i] || mp->waiting_list_size != waiting[i]) same = 0;
+        if(waiting[i] && mp->waiting_list[0]->id != first_waiting[i]) same = 0;
+        if(sector_bitmap_test(sim->ccm->occupied_sectors, i) != (occupant[i] >= 0)) same = 0;
+        if(sector_bitmap_test(sim->ccm->waiting_sectors, i) != (waiting[i] > 0)) same = 0;
+    }
+    check(same, "sectors, waiting lists and bitmaps restored from the standby's copy");
+    check(sim->ccm->wait_timers->armed_count == armed && armed == 2, "deadlines of the waiting aeronaves armed again");
+
+    AirspaceSnapshot *snapshot = create_airspace_snapshot(sim);
+    snapshot_airspace(sim, snapshot);
+    check(snapshot->occupied == 2 && snapshot->waiting == 2, "snapshots see the restored state");
+    destroy_airspace_snapshot(snapshot);
+
+    destroy_simulation(sim);
+
+    // the standby applies the log late: an aeronave reused in the meantime has another priority, the waiting list
+    // of the standby must still be the one of the primary
+    sim = create_simulation(1, 4, 7);
+    sim->ccm->verbose = 0;
+    sim->procedural_routes = 1;
+    int first_priorities[] = {10, 300, 200, 100};
+    for(int i = 0; i < 4; i++) sim->aeronaves[i] = create_aeronave(sim, i, first_priorities[i], 3);
+    r = create_replication(sim, 1000);
+    send(sim, 0, 0, 0, -1, 0);                      // aeronave 0 gets sector 0, 1, 2 and 3 wait in this order
+    send(sim, 0, 2, 0, -1, 0);
+    send(sim, 0, 3, 0, -1, 0);
+    send(sim, 0, 1, 0, -1, 0);
+    int order[3];
+    for(int i = 0; i < 3; i++) order[i] = sim->ccm->mutex_sections[0]->waiting_list[i]->id;
+    sim->aeronaves[1]->priority = 5;                // new priorities before the standby reads the log
+    sim->aeronaves[3]->priority = 900;
+    sim->ccm->mutex_sections[0]->waiting_list_size = 0;
+    __atomic_store_n(&r->heartbeat_ns, 1, __ATOMIC_RELEASE);
+    sim->stop = 1;                                  // the standby takes over at once and stops (nothing queued)
+    run_standby_ccm(sim);
+    MutexPriority *mp = sim->ccm->mutex_sections[0];
+    check(r->failovers == 1 && mp->waiting_list_size == 3 && mp->waiting_list[0]->id == order[0]
+          && mp->waiting_list[1]->id == order[1] && mp->waiting_list[2]->id == order[2],
+          "waiting list of the standby in the order of the primary, not by the current priorities");
+    destroy_simulation(sim);
+
+    printf("\n[TEST] %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "structures.h"
+#include "tests_check.h"
+
+int main(void){ // compile with: make tests_routes
+    int n = 64, tam = 1000;
+    Simulation *a = create_simulation(n, 2, 42);
+    Simulation *b = create_simulation(n, 2, 42);
+    a->ccm->verbose = 0;
+    b->ccm->verbose = 0;
+    a->procedural_routes = 1;
+    b->procedural_routes = 1;
+    a->aeronaves[0] = create_aeronave(a, 0, 10, tam);
+    b->aeronaves[0] = create_aeronave(b, 0, 10, tam);
+    Aeronave *x = a->aeronaves[0], *y = b->aeronaves[0];
+    check(x->rota == NULL && x->rota_capacity == 0, "procedural route has no rota array");
+
+    // same seed, same route; every hop exists and is different from the one before it
+    int *hops = malloc(sizeof(int) * tam);
+    int same = 1, valid = 1;
+    for(int i = 0; i < tam; i++){
+        hops[i] = aeronave_route_sector(a, x, i);
+        if(hops[i] != aeronave_route_sector(b, y, i)) same = 0;
+        if(hops[i] < 0 || hops[i] >= n || (i > 0 && hops[i] == hops[i-1])) valid = 0;
+    }
+    check(same, "procedural route is reproducible from the seed of the simulation");
+    check(valid, "every hop is a sector, two consecutive hops are different");
+    check(aeronave_route_sector(a, x, tam) == -1, "no hop after the end of the route");
+
+    // going back regenerates the same hops
+    int again = 1;
+    for(int i = tam - 1; i >= 0; i -= 97){
+        if(aeronave_route_sector(a, x, i) != hops[i]) again = 0;
+    }
+    check(again, "hops read out of order are the same");
+
+    // reroute after a timeout: the request for hop 5 timed out (the aeronave holds no sector)
+    aeronave_route_sector(a, x, 5);
+    x->current_index_rota = 5;
+    int first = reroute_aeronave(a, x);
+    check(first >= 0 && first != hops[5], "reroute picks a sector different from the one that timed out");
+    check(aeronave_route_sector(a, x, 5) == first, "rerouted hop is the next one of the procedural route");
+    int second = reroute_aeronave(a, x);
+    check(second >= 0 && second != first, "second reroute starts from the first one");
+    check(aeronave_route_sector(a, x, 5) == second, "procedural route isn't rewound to the seed by a reroute");
+    int next = aeronave_route_sector(a, x, 6);
+    check(next >= 0 && next != second, "hops after a reroute are generated from the new sector");
+    x->current_index_rota = 0;
+
+    // an explicit route coexists with the procedural ones
+    a->aeronaves[1] = create_aeronave(a, 1, 10, 5);
+    int rota[] = {3, 7, 3, 63};
+    check(set_aeronave_rota(a, a->aeronaves[1], rota, 4) == 0, "explicit route is accepted");
+    check(aeronave_route_sector(a, a->aeronaves[1], 3) == 63 && a->aeronaves[1]->tam_rota == 4, "explicit route is used");
+    int bad[] = {3, 3};
+    check(set_aeronave_rota(a, a->aeronaves[1], bad, 2) < 0, "route with the same sector twice in a row is refused");
+    int outside[] = {1, 64};
+    check(set_aeronave_rota(a, a->aeronaves[1], outside, 2) < 0, "route with an unknown sector is refused");
+
+    // routes file: line i is the route of aeronave i
+    FILE *f = fopen("/tmp/tests_routes.txt", "w");
+    fprintf(f, "1 2 3\n\n5,6\n");
+    fclose(f);
+    check(load_routes_file(a, "/tmp/tests_routes.txt") == 2, "two routes loaded from the file");
+    check(a->aeronaves[0]->rota != NULL && a->aeronaves[0]->tam_rota == 3 && aeronave_route_sector(a, a->aeronaves[0], 2) == 3, "first line is the route of aeronave 0");
+    check(a->aeronaves[1]->tam_rota == 2 && aeronave_route_sector(a, a->aeronaves[1], 1) == 6, "empty lines are skipped");
+    f = fopen("/tmp/tests_routes.txt", "w");
+    fprintf(f, "1 2 x3\n");
+    fclose(f);
+    check(load_routes_file(a, "/tmp/tests_routes.txt") == -1, "file with a sector that isn't a number is refused");
+    f = fopen("/tmp/tests_routes.txt", "w");
+    fprintf(f, "1 99999999999999999999\n");
+    fclose(f);
+    check(load_routes_file(a, "/tmp/tests_routes.txt") == -1, "file with a sector out of range is refused");
+    check(a->aeronaves[0]->tam_rota == 3 && aeronave_route_sector(a, a->aeronaves[0], 0) == 1, "a refused line doesn't change the route");
+    remove("/tmp/tests_routes.txt");
+
+    // a finished aeronave becomes procedural again when it is reused
+    check(reset_aeronave(a, a->aeronaves[0], 10, 50) == 0 && a->aeronaves[0]->rota == NULL, "reused aeronave gets a procedural route");
+
+    free(hops);
+    destroy_simulation(a);
+    destroy_simulation(b);
+
+    printf("\n[TEST] %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
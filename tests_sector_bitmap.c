@@ -0,0 +1,94 @@
+#define _DEFAULT_SOURCE  // Enable usleep and other POSIX features
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "structures.h"
+#include "tests_check.h"
+
+int main(void){ // compile with: make tests_sector_bitmap
+    int n = 200; // more than 3 words, the last one only partially used
+
+    SectorBitmap *occupied = create_sector_bitmap(n);
+    check(occupied != NULL && occupied->num_words == 4, "bitmap of 200 sectors uses 4 words");
+    check(sector_bitmap_count(occupied) == 0, "new bitmap is empty");
+    check(sector_bitmap_find_first_set(occupied) == -1, "no first set bit in an empty bitmap");
+    check(sector_bitmap_find_first_clear(occupied) == 0, "first free sector of an empty bitmap is 0");
+
+    sector_bitmap_set(occupied, 0);
+    sector_bitmap_set(occupied, 63);
+    sector_bitmap_set(occupied, 64);
+    sector_bitmap_set(occupied, 199);
+    check(sector_bitmap_count(occupied) == 4, "popcount after 4 sets");
+    check(sector_bitmap_test(occupied, 63) && sector_bitmap_test(occupied, 64) && !sector_bitmap_test(occupied, 65), "test across a word boundary");
+    check(sector_bitmap_find_first_set(occupied) == 0, "first set bit");
+    check(sector_bitmap_find_first_clear(occupied) == 1, "first clear bit");
+
+    sector_bitmap_clear(occupied, 0);
+    check(!sector_bitmap_test(occupied, 0) && sector_bitmap_count(occupied) == 3, "clear");
+    check(sector_bitmap_find_first_set(occupied) == 63, "first set bit after clear");
+
+    for(int i = 0; i < n; i++) sector_bitmap_set(occupied, i);
+    check(sector_bitmap_count(occupied) == n, "every sector occupied");
+    check(sector_bitmap_find_first_clear(occupied) == -1, "no free sector when they are all occupied (bits after 200 are ignored)");
+
+    // a route going through sectors 10, 70 and 150
+    SectorBitmap *route = create_sector_bitmap(n);
+    sector_bitmap_set(route, 10);
+    sector_bitmap_set(route, 70);
+    sector_bitmap_set(route, 150);
+    check(sector_bitmap_count_and(occupied, route) == 3, "every sector of the route is occupied");
+    check(sector_bitmap_find_first_clear_in(occupied, route) == -1, "no free sector in the route");
+    sector_bitmap_clear(occupied, 150);
+    sector_bitmap_clear(occupied, 70);
+    check(sector_bitmap_count_and(occupied, route) == 1, "one sector of the route is occupied");
+    check(sector_bitmap_find_first_clear_in(occupied, route) == 70, "first free sector of the route");
+
+    destroy_sector_bitmap(route);
+    destroy_sector_bitmap(occupied);
+
+    // the bitmaps of the CCM follow the grants, waits, releases, handoffs and timeouts of control_priority()
+    Simulation *sim = create_simulation(3, 4, 1);
+    sim->ccm->verbose = 0;
+    for(int i = 0; i < 4; i++) sim->aeronaves[i] = create_aeronave(sim, i, 10 * i, 3);
+    RequestSector req = {0};
+    req.id_sector_from = -1;
+    req.id_aeronave = 0; req.id_sector = 0;
+    control_priority(sim, &req);                 // aeronave 0 gets sector 0
+    check(count_occupied_sectors(sim->ccm) == 1 && count_waiting_sectors(sim->ccm) == 0 && check_sector_bitmaps(sim) == 0, "grant: sector 0 occupied");
+    req.id_aeronave = 1;
+    control_priority(sim, &req);                 // aeronave 1 waits for sector 0
+    req.id_aeronave = 2; req.deadline_ns = monotonic_ns();
+    control_priority(sim, &req);                 // aeronave 2 too, but its deadline has passed
+    req.deadline_ns = 0;
+    check(count_waiting_sectors(sim->ccm) == 1 && sector_bitmap_test(sim->ccm->waiting_sectors, 0) && check_sector_bitmaps(sim) == 0, "wait: sector 0 has a waiting list");
+    req.id_aeronave = 3; req.id_sector = 1;
+    control_priority(sim, &req);                 // aeronave 3 gets sector 1
+    req.request_type = 2; req.id_sector = 0; req.id_sector_from = 1;
+    control_priority(sim, &req);                 // and hands it off for the busy sector 0: it waits, sector 1 is freed
+    check(count_occupied_sectors(sim->ccm) == 1 && !sector_bitmap_test(sim->ccm->occupied_sectors, 1) && check_sector_bitmaps(sim) == 0, "busy handoff: sector left is free");
+    for(int i = 0; i < 100 && expire_wait_timeouts(sim) == 0; i++) usleep(1000);
+    check(sim->ccm->mutex_sections[0]->waiting_list_size == 2 && check_sector_bitmaps(sim) == 0, "timeout: aeronave 2 left the waiting list");
+    req.request_type = 1; req.id_sector_from = -1;
+    for(int a = 0; a < 3; a++){                  // 0, then 3 and 1 (higher priority first) leave sector 0
+        req.id_aeronave = sim->sectors[0]->id_aeronave_occupying;
+        control_priority(sim, &req);
+        if(check_sector_bitmaps(sim) != 0) break;
+    }
+    check(count_occupied_sectors(sim->ccm) == 0 && count_waiting_sectors(sim->ccm) == 0 && check_sector_bitmaps(sim) == 0, "releases: every sector is free");
+    sector_bitmap_set(sim->ccm->occupied_sectors, 2);
+    check(check_sector_bitmaps(sim) == 1, "a bitmap out of sync is found");
+    sector_bitmap_clear(sim->ccm->occupied_sectors, 2);
+
+    // what trabalho_final reports at the end: the last releases are still queued when stop is set
+    req.request_type = 0; req.id_aeronave = 0; req.id_sector = 1;
+    control_priority(sim, &req);
+    req.request_type = 1; req.tier = 0;
+    enqueue_request(sim->ccm, &req);
+    sim->stop = 1;
+    run_centralized_control(sim);
+    check(is_request_queue_empty(sim->ccm) && count_occupied_sectors(sim->ccm) == 0 && check_sector_bitmaps(sim) == 0, "the CCM processes the queued release before it stops");
+    destroy_simulation(sim);
+
+    printf("\n[TEST] %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
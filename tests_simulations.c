@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "structures.h"
+#include "tests_check.h"
+
+// several simulations at the same time in one process: each one must only see its own sectors, aeronaves and CCM
+
+typedef struct{
+    Simulation *sim;
+    Aeronave *aeronave;
+}Flight;
+
+static void* fly(void *arg){
+    Flight *f = (Flight *)arg;
+    init_aeronave(f->sim, f->aeronave);
+    return NULL;
+}
+
+static void* own_ccm(void *arg){
+    run_centralized_control((Simulation *)arg);
+    return NULL;
+}
+
+static void* shared_ccm(void *arg){
+    run_shared_centralized_control((Simulation **)arg, 2);
+    return NULL;
+}
+
+static Simulation* new_simulation(int number_sectors, int number_aeronaves, unsigned int seed, int tam_rota){
+    Simulation *sim = create_simulation(number_sectors, number_aeronaves, seed);
+    sim->ccm->verbose = 0;
+    sim->ccm->max_dwell_ms = 1;
+    sim->procedural_routes = 1;
+    for(int i = 0; i < number_aeronaves; i++) sim->aeronaves[i] = create_aeronave(sim, i, (int)(rand_r(&sim->seed) % 1000), tam_rota);
+    return sim;
+}
+
+// flies every aeronave of both simulations at the same time; shared: one CCM thread for both
+static void run_both(Simulation **sims, int shared){
+    int total = sims[0]->number_aeronaves + sims[1]->number_aeronaves, k = 0;
+    pthread_t *threads = malloc(sizeof(pthread_t) * total);
+    Flight *flights = malloc(sizeof(Flight) * total);
+    pthread_t ccm_threads[2];
+    if(shared) pthread_create(&ccm_threads[0], NULL, shared_ccm, sims);
+    else for(int s = 0; s < 2; s++) pthread_create(&ccm_threads[s], NULL, own_ccm, sims[s]);
+    for(int s = 0; s < 2; s++){
+        for(int i = 0; i < sims[s]->number_aeronaves; i++, k++){
+            flights[k].sim = sims[s];
+            flights[k].aeronave = sims[s]->aeronaves[i];
+            pthread_create(&threads[k], NULL, fly, &flights[k]);
+        }
+    }
+    for(k = 0; k < total; k++) pthread_join(threads[k], NULL);
+    for(int s = 0; s < 2; s++) sims[s]->stop = 1;
+    for(int s = 0; s < (shared ? 1 : 2); s++) pthread_join(ccm_threads[s], NULL);
+    free(threads);
+    free(flights);
+}
+
+// every hop of every aeronave of this simulation was granted by its own CCM, and nothing is left behind
+static int simulation_ok(Simulation *sim){
+    uint64_t hops = 0, grants = 0;
+    for(int i = 0; i < sim->number_aeronaves; i++){
+        if(sim->aeronaves[i]->current_index_rota != sim->aeronaves[i]->tam_rota) return 0;
+        hops += sim->aeronaves[i]->tam_rota;
+    }
+    for(int t = 0; t < NUM_SERVICE_TIERS; t++) grants += sim->ccm->grant_latency[t].total;
+    return grants == hops && is_request_queue_empty(sim->ccm) && count_occupied_sectors(sim->ccm) == 0
+        && count_waiting_sectors(sim->ccm) == 0 && check_sector_bitmaps(sim) == 0;
+}
+
+int main(void){ // compile with: make tests_simulations
+    for(int shared = 0; shared < 2; shared++){
+        Simulation *sims[2];
+        sims[0] = new_simulation(8, 16, 1, 6);
+        sims[1] = new_simulation(3, 12, 2, 9); // few sectors: a lot of waiting lists and handoffs
+        Simulation *alone = new_simulation(8, 16, 1, 6);
+        run_both(sims, shared);
+
+        char message[128];
+        snprintf(message, sizeof(message), "%s: first simulation flew every hop", shared ? "shared CCM thread" : "one CCM thread each");
+        check(simulation_ok(sims[0]), message);
+        snprintf(message, sizeof(message), "%s: second simulation flew every hop", shared ? "shared CCM thread" : "one CCM thread each");
+        check(simulation_ok(sims[1]), message);
+
+        // the routes only depend on the seed of their own simulation, not on the other one running next to it
+        int same = 1;
+        for(int i = 0; i < 16; i++){
+            if(sims[0]->aeronaves[i]->route_seed != alone->aeronaves[i]->route_seed || sims[0]->aeronaves[i]->priority != alone->aeronaves[i]->priority) same = 0;
+        }
+        snprintf(message, sizeof(message), "%s: routes and priorities are the same as a simulation run alone", shared ? "shared CCM thread" : "one CCM thread each");
+        check(same, message);
+
+        destroy_simulation(sims[0]);
+        destroy_simulation(sims[1]);
+        destroy_simulation(alone);
+    }
+
+    printf("\n[TEST] %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
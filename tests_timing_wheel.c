@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "structures.h"
+#include "tests_check.h"
+
+typedef struct{
+    TimingWheel *wheel;
+    uint64_t *expected_tick; // tick at which each timer must expire
+    int *fired;
+    int wrong_tick;
+}Expiries;
+
+static void on_expire(TimerNode * timer, void * arg){
+    Expiries *e = (Expiries *)arg;
+    e->fired[timer->id_aeronave]++;
+    if(e->wheel->current_tick != e->expected_tick[timer->id_aeronave]){
+        printf("timer %d expired at tick %llu instead of %llu\n", timer->id_aeronave,
+               (unsigned long long)e->wheel->current_tick, (unsigned long long)e->expected_tick[timer->id_aeronave]);
+        e->wrong_tick++;
+    }
+}
+
+int main(void){ // compile with: make tests_timing_wheel
+    int n = 2000;
+    uint64_t start = 1000 * WHEEL_TICK_NS;
+    TimingWheel *wheel = create_timing_wheel(n, start);
+    Expiries e = {wheel, malloc(n * sizeof(uint64_t)), calloc(n, sizeof(int)), 0};
+
+    // deadlines spread on every level of the wheel (up to ~2.2 million ticks), some timers on the same tick
+    srand(42);
+    for(int i = 0; i < n; i++){
+        uint64_t ticks = (i % 4 == 0) ? (uint64_t)(rand() % 64 + 1)
+                       : (i % 4 == 1) ? (uint64_t)(rand() % 4096 + 1)
+                       : (i % 4 == 2) ? (uint64_t)(rand() % 262144 + 1)
+                       : (uint64_t)(rand() % 2200000 + 1);
+        e.expected_tick[i] = ticks;
+        timing_wheel_add(wheel, i, i % 7, start + ticks * WHEEL_TICK_NS);
+    }
+    check(wheel->armed_count == n, "every timer is armed");
+
+    // cancel one timer out of 5
+    int cancelled = 0;
+    for(int i = 0; i < n; i += 5){
+        timing_wheel_cancel(wheel, i);
+        cancelled++;
+    }
+    check(wheel->armed_count == n - cancelled, "cancelled timers are disarmed");
+
+    // advance with irregular steps, as the CCM loop would
+    uint64_t now = start;
+    int expired = 0;
+    while(now < start + 2300000 * WHEEL_TICK_NS){
+        now += (uint64_t)(rand() % 5000 + 1) * WHEEL_TICK_NS / 3;
+        expired += timing_wheel_advance(wheel, now, on_expire, &e);
+    }
+    int fired_once = 1, cancelled_fired = 0;
+    for(int i = 0; i < n; i++){
+        if(i % 5 == 0){
+            if(e.fired[i]) cancelled_fired = 1;
+        }
+        else if(e.fired[i] != 1){
+            fired_once = 0;
+        }
+    }
+    check(expired == n - cancelled, "every timer not cancelled expired");
+    check(fired_once, "each timer expired exactly once");
+    check(!cancelled_fired, "cancelled timers never expire");
+    check(e.wrong_tick == 0, "each timer expired at its own tick");
+    check(wheel->armed_count == 0, "no timer left in the wheel");
+
+    // a deadline that already passed expires at the next tick
+    timing_wheel_add(wheel, 1, 0, start);
+    e.expected_tick[1] = wheel->current_tick + 1;
+    e.fired[1] = 0;
+    check(timing_wheel_advance(wheel, now, on_expire, &e) == 0, "late timer doesn't expire before the next tick");
+    check(timing_wheel_advance(wheel, now + WHEEL_TICK_NS, on_expire, &e) == 1 && e.fired[1] == 1, "late timer expires at the next tick");
+
+    // re-arming a timer replaces its deadline
+    timing_wheel_add(wheel, 2, 0, now + 10 * WHEEL_TICK_NS);
+    timing_wheel_add(wheel, 2, 0, now + 100 * WHEEL_TICK_NS);
+    check(wheel->armed_count == 1, "re-armed timer is counted once");
+    check(timing_wheel_advance(wheel, now + 50 * WHEEL_TICK_NS, on_expire, &e) == 0, "re-armed timer doesn't expire at its old deadline");
+    timing_wheel_cancel(wheel, 2);
+
+    // a deadline beyond the range of the wheel (~4.6h): it must not expire at the end of the range
+    uint64_t range = (uint64_t)1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS);
+    now = start + wheel->current_tick * WHEEL_TICK_NS;
+    uint64_t far_ticks = range + range / 2 + 7;
+    timing_wheel_add(wheel, 3, 0, now + far_ticks * WHEEL_TICK_NS);
+    e.expected_tick[3] = wheel->current_tick + far_ticks;
+    e.fired[3] = 0;
+    check(timing_wheel_advance(wheel, now + (far_ticks - 1) * WHEEL_TICK_NS, on_expire, &e) == 0 && wheel->armed_count == 1, "far timer is still armed after the range of the wheel");
+    check(timing_wheel_advance(wheel, now + far_ticks * WHEEL_TICK_NS, on_expire, &e) == 1 && e.fired[3] == 1 && e.wrong_tick == 0, "far timer expires at its own deadline");
+
+    free(e.expected_tick);
+    free(e.fired);
+    destroy_timing_wheel(wheel);
+
+    printf("\n[TEST] %d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+
+// Reads a trace written by trabalho_final -X (built with make TRACE=1) and rebuilds the life of every request:
+//   enqueue -> dequeue -> [waitlist_insert -> waitlist_remove] -> grant -> wake -> acquire
+// then prints where the time went: request queue, waiting list, CCM, wake up and acquire (trylock retries).
+
+typedef struct{
+    int active;
+    int waited;             // went through the waiting list
+    uint64_t enqueue, dequeue, insert, remove, grant, wake;
+}PendingRequest;
+
+typedef struct{
+    TraceEvent event;
+    long index;             // position in the file, keeps the order of events with the same timestamp
+}TraceLine;
+
+static int compare_lines(const void *a, const void *b) {
+    const TraceLine *x = (const TraceLine *)a, *y = (const TraceLine *)b;
+    if (x->event.ts_ns != y->event.ts_ns) return x->event.ts_ns < y->event.ts_ns ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static void print_histogram(char *name, LatencyHistogram *h) {
+    if (h->total == 0) {
+        printf("[TRACE_REPORT] %-28s no request\n", name);
+        return;
+    }
+    printf("[TRACE_REPORT] %-28s %8llu requests, mean %10.3f us, p50 %10.3f us, p99 %10.3f us, max %10.3f us\n",
+           name, (unsigned long long)h->total, latency_histogram_mean(h) / 1e3,
+           latency_histogram_percentile(h, 50) / 1e3, latency_histogram_percentile(h, 99) / 1e3, h->max_ns / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage : %s <trace.csv>\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "r");
+    if (!f) {
+        printf("[TRACE_REPORT] Error: can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    long num_lines = 0, capacity = 1024;
+    TraceLine *lines = malloc(sizeof(TraceLine) * capacity);
+    int max_aeronave = -1;
+    long bad_lines = 0;
+    char line[256], name[64];
+    if (!fgets(line, sizeof(line), f)) line[0] = '\0'; // header
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long ts;
+        TraceEvent e;
+        if (sscanf(line, "%llu,%63[^,],%d,%d,%d", &ts, name, &e.id_aeronave, &e.id_sector, &e.detail) != 5
+            || (e.type = parse_trace_event(name)) < 0 || e.id_aeronave < 0) {
+            bad_lines++;
+            continue;
+        }
+        e.ts_ns = ts;
+        if (num_lines == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, sizeof(TraceLine) * capacity);
+        }
+        lines[num_lines].event = e;
+        lines[num_lines].index = num_lines;
+        num_lines++;
+        if (e.id_aeronave > max_aeronave) max_aeronave = e.id_aeronave;
+    }
+    fclose(f);
+    // every thread takes its own timestamp: sort them, the events of a request are in order in its threads
+    qsort(lines, num_lines, sizeof(TraceLine), compare_lines);
+
+    int num_aeronaves = max_aeronave + 1;
+    PendingRequest *pending = calloc(num_aeronaves > 0 ? num_aeronaves : 1, sizeof(PendingRequest));
+    uint64_t *release_enqueue = calloc(num_aeronaves > 0 ? num_aeronaves : 1, sizeof(uint64_t));
+    long counts[NUM_TRACE_EVENTS] = {0};
+    long timed_out = 0, broken = 0;
+    LatencyHistogram queue, waitlist, ccm, wake, acquire, total, release_queue, until_timeout;
+    LatencyHistogram *histograms[] = {&queue, &waitlist, &ccm, &wake, &acquire, &total, &release_queue, &until_timeout};
+    for (int i = 0; i < 8; i++) latency_histogram_init(histograms[i]);
+
+    for (long i = 0; i < num_lines; i++) {
+        TraceEvent *e = &lines[i].event;
+        PendingRequest *p = &pending[e->id_aeronave];
+        counts[e->type]++;
+        if ((e->type == TRACE_ENQUEUE || e->type == TRACE_DEQUEUE) && e->detail == 1) { // release requests
+            if (e->type == TRACE_ENQUEUE) release_enqueue[e->id_aeronave] = e->ts_ns;
+            else if (release_enqueue[e->id_aeronave]) latency_histogram_record(&release_queue, e->ts_ns - release_enqueue[e->id_aeronave]);
+            continue;
+        }
+        if (e->type == TRACE_ENQUEUE) {
+            if (p->active) broken++; // the previous request never ended (dropped events)
+            memset(p, 0, sizeof(PendingRequest));
+            p->active = 1;
+            p->enqueue = e->ts_ns;
+            continue;
+        }
+        if (!p->active) continue; // the start of the request isn't in the trace
+        switch (e->type) {
+            case TRACE_DEQUEUE: p->dequeue = e->ts_ns; break;
+            case TRACE_WAITLIST_INSERT: p->insert = e->ts_ns; p->waited = 1; break;
+            case TRACE_WAITLIST_REMOVE: p->remove = e->ts_ns; break;
+            case TRACE_GRANT: p->grant = e->ts_ns; break;
+            case TRACE_WAKE:
+                p->wake = e->ts_ns;
+                if (e->detail == WAIT_TIMED_OUT) {
+                    latency_histogram_record(&until_timeout, p->wake - p->enqueue);
+                    timed_out++;
+                    p->active = 0;
+                }
+                break;
+            case TRACE_ACQUIRE:
+                if (!p->dequeue || !p->grant || !p->wake || (p->waited && !p->remove)) {
+                    broken++;
+                }
+                else {
+                    latency_histogram_record(&queue, p->dequeue - p->enqueue);
+                    if (p->waited) latency_histogram_record(&waitlist, p->remove - p->insert);
+                    // time in the CCM itself: the processing of the request, and of the release that handed the sector
+                    uint64_t in_ccm = p->waited ? (p->insert - p->dequeue) + (p->grant - p->remove) : p->grant - p->dequeue;
+                    latency_histogram_record(&ccm, in_ccm);
+                    latency_histogram_record(&wake, p->wake - p->grant);
+                    latency_histogram_record(&acquire, e->ts_ns - p->wake);
+                    latency_histogram_record(&total, e->ts_ns - p->enqueue);
+                }
+                p->active = 0;
+                break;
+            default: break;
+        }
+    }
+    long unfinished = 0;
+    for (int a = 0; a < num_aeronaves; a++) unfinished += pending[a].active;
+
+    printf("[TRACE_REPORT] %ld events of %d aeronaves in %s (%ld unreadable lines)\n", num_lines, num_aeronaves, argv[1], bad_lines);
+    printf("[TRACE_REPORT] events:");
+    for (int t = 0; t < NUM_TRACE_EVENTS; t++) printf(" %s %ld%s", trace_event_name(t), counts[t], t + 1 < NUM_TRACE_EVENTS ? "," : "\n");
+    printf("[TRACE_REPORT] requests: %llu granted (%llu through a waiting list), %ld timed out, %ld unfinished, %ld incomplete\n",
+           (unsigned long long)total.total, (unsigned long long)waitlist.total, timed_out, unfinished, broken);
+    print_histogram("queue (enqueue->dequeue)", &queue);
+    print_histogram("waiting list", &waitlist);
+    print_histogram("CCM processing", &ccm);
+    print_histogram("wake (grant->wake)", &wake);
+    print_histogram("acquire (wake->acquire)", &acquire);
+    print_histogram("total (enqueue->acquire)", &total);
+    print_histogram("release queue", &release_queue);
+    print_histogram("timed out after", &until_timeout);
+
+    free(pending);
+    free(release_enqueue);
+    free(lines);
+    return 0;
+}